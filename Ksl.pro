@@ -11,6 +11,7 @@ lessThan(QT_MAJOR_VERSION, 5) {
 }
 
 LIBS += -lgsl -lgslcblas
+unix: LIBS += -lpthread
 DEFINES += KSL_DEBUG_MODE
 
 
@@ -29,12 +30,30 @@ INCLUDEPATH += \
 
 HEADERS += \
     src/Core/Ksl/Array.h \
+    src/Core/Ksl/ArrayExpr.h \
+    src/Core/Ksl/ArrayReduce.h \
+    src/Core/Ksl/ArrayProduct.h \
+    src/Core/Ksl/ArrayApply.h \
+    src/Core/Ksl/ArraySort.h \
+    src/Core/Ksl/ArrayAxis.h \
+    src/Core/Ksl/ArrayRing.h \
+    src/Core/Ksl/ArrayTranspose.h \
+    src/Core/Ksl/ArrayAllocator.h \
+    src/Core/Ksl/ArrayMapping.h \
+    src/Core/Ksl/Random.h \
+    src/Core/Ksl/Npy.h \
+    src/Core/Ksl/Npy_p.h \
     src/Core/Ksl/Global.h \
     src/Core/Ksl/Math.h \
     src/Core/Ksl/Object.h \
     src/Core/Ksl/Object_p.h \
     src/Core/Ksl/MemoryPool.h \
+    src/Core/Ksl/MemoryStats.h \
+    src/Core/Ksl/ConcurrentMemoryPool.h \
+    src/Core/Ksl/ThreadPool.h \
+    src/Core/Ksl/ThreadPool_p.h \
     src/Core/Ksl/MemoryPool_p.h \
+    src/Core/Ksl/ConcurrentMemoryPool_p.h \
     src/Core/Ksl/Graph.h \
     src/Core/Ksl/Functions.h \
     src/Core/Ksl/Csv.h \
@@ -81,7 +100,13 @@ HEADERS += \
 SOURCES += \
     tests/chart.cpp \
     src/Core/Ksl/MemoryPool.cpp \
+    src/Core/Ksl/MemoryStats.cpp \
+    src/Core/Ksl/ConcurrentMemoryPool.cpp \
+    src/Core/Ksl/ThreadPool.cpp \
     src/Core/Ksl/Csv.cpp \
+    src/Core/Ksl/ArrayAllocator.cpp \
+    src/Core/Ksl/ArrayMapping.cpp \
+    src/Core/Ksl/Npy.cpp \
     src/Plotting/Ksl/CanvasWindow.cpp \
     src/Plotting/Ksl/Chart.cpp \
     src/Plotting/Ksl/Figure.cpp \
@@ -22,9 +22,29 @@
 #define KSL_ARRAY_H
 
 #include <Ksl/Math.h>
+#include <Ksl/ArrayExpr.h>
+#include <Ksl/ArrayAllocator.h>
+#include <Ksl/MemoryStats.h>
+#include <Ksl/ArrayTranspose.h>
+#include <Ksl/Random.h>
 #include <ostream>
 #include <initializer_list>
 #include <cstdlib>
+#include <algorithm>
+#include <limits>
+#include <new>
+#include <iterator>
+#include <functional>
+
+#ifndef KSL_SINGLE_THREADED
+#include <atomic>
+#endif // KSL_SINGLE_THREADED
+
+// Arrays up to this many bytes keep their elements
+// inside the storage block, saving one allocation
+#ifndef KSL_ARRAY_INLINE_BYTES
+#define KSL_ARRAY_INLINE_BYTES 64
+#endif
 
 namespace Ksl {
 
@@ -35,6 +55,55 @@ namespace Ksl {
 template <int D, typename T=double> class Array{};
 
 
+/*********************************************
+ * Reference counter of array storages. It is
+ * atomic so arrays and views can be handed
+ * between threads, defining KSL_SINGLE_THREADED
+ * turns it into a plain int
+ *********************************************/
+class ArrayRefCount
+{
+public:
+
+    ArrayRefCount(int count=1)
+        : m_count(count)
+    { }
+
+#ifndef KSL_SINGLE_THREADED
+
+    int load() const { return m_count.load(std::memory_order_acquire); }
+
+    void ref() { m_count.fetch_add(1, std::memory_order_relaxed); }
+
+    // Only the last owner sees true, and it also sees
+    // every write made by the other owners before
+    // they dropped their references
+    bool unref() {
+        return m_count.fetch_sub(1, std::memory_order_acq_rel) == 1;
+    }
+
+
+private:
+
+    std::atomic<int> m_count;
+
+#else // KSL_SINGLE_THREADED
+
+    int load() const { return m_count; }
+
+    void ref() { m_count += 1; }
+
+    bool unref() { return (--m_count == 0); }
+
+
+private:
+
+    int m_count;
+
+#endif // KSL_SINGLE_THREADED
+};
+
+
 /*********************************************
  * This is a reference counting storage engine 
  * for the other array types
@@ -44,20 +113,51 @@ class Array<0,Tp>
 {
 public:
     
-    Array(int rows, int cols);
-    Array(int rows, int cols, const Tp &initValue);
+    Array(Index rows, Index cols,
+          ArrayAllocator &allocator=ArrayAllocator::current());
+    Array(Index rows, Index cols, const Tp &initValue,
+          ArrayAllocator &allocator=ArrayAllocator::current());
+    Array(Index rows, Index cols, Tp *data,
+          ArrayBufferOwner *owner, bool readOnly=false);
     ~Array();
     
-    int rows() const { return m_rows; }
-    int cols() const { return m_cols; }
-    int size() const { return m_rows*m_cols; }
-    int capacity() const { return m_allocSize; }
+    Index rows() const { return m_rows; }
+    Index cols() const { return m_cols; }
+    Index size() const { return m_rows*m_cols; }
+    Index capacity() const { return m_allocSize; }
+    int refCount() const { return m_refCount.load(); }
+    bool isInline() const { return m_data == inlineData(); }
+    ArrayAllocator& allocator() const { return *m_allocator; }
+
+    // Buffers owned by someone else may be read only,
+    // arrays copy them before writing
+    ArrayBufferOwner* owner() const { return m_owner; }
+    bool isReadOnly() const { return m_readOnly; }
+
+    // Bytes of this block and of its allocated buffer,
+    // buffers owned by someone else are not counted
+    qint64 memoryUsage() const {
+        return qint64(sizeof(*this)) + ((isInline() || m_owner)
+            ? 0 : qint64(m_allocSize)*qint64(sizeof(Tp)));
+    }
+
+    ArrayLayout layout() const { return m_layout; }
+    void setLayout(ArrayLayout layout) { m_layout = layout; }
+
+    // Position of element (i,j) in the buffer
+    Index offsetOf(Index i, Index j) const {
+        return (m_layout == RowMajor) ? i*m_cols + j : j*m_rows + i;
+    }
+
+    Tp& valueAt(Index idx) { return m_data[idx]; }
+    const Tp& valueAt(Index idx) const { return m_data[idx]; }
 
-    Tp& valueAt(int idx) { return m_data[idx]; }
-    const Tp& valueAt(int idx) const { return m_data[idx]; }
+    Tp* rowAt(Index idx) { return m_data + (idx*m_cols); }
+    const Tp* rowAt(Index idx) const { return m_data + (idx*m_cols); }
 
-    Tp* rowAt(int idx) { return m_data + (idx*m_cols); }
-    const Tp* rowAt(int idx) const { return m_data + (idx*m_cols); }
+    // Row idx of a row major matrix, column idx of a column major one
+    Tp* lineAt(Index idx) { return m_data + idx*(m_layout == RowMajor ? m_cols : m_rows); }
+    const Tp* lineAt(Index idx) const { return m_data + idx*(m_layout == RowMajor ? m_cols : m_rows); }
 
     Tp* begin() { return m_data; }
     const Tp* begin() const { return m_data; }
@@ -65,44 +165,104 @@ public:
     Tp* end() { return m_data + m_rows*m_cols; }
     const Tp* end() const { return m_data + m_rows*m_cols; }
 
-    void alloc(int rows, int cols);
-    void resize(int rows, int cols);
-    void reserve(int size);
+    void alloc(Index rows, Index cols);
+    void resize(Index rows, Index cols);
+    void reserve(Index size);
     void free();
     
     void append(const Tp &value);
     
+    Array* clone() const;
     Array* ref();
     bool unref();
 
+    // Blocks come from the current allocator of the
+    // thread, see ArrayAllocator::allocateStorage(),
+    // or from the one given, and the allocator is kept
+    // in front of the block
+    static void* operator new(std::size_t bytes);
+    static void* operator new(std::size_t bytes, ArrayAllocator &allocator);
+    static void operator delete(void *ptr, std::size_t bytes);
+    static void operator delete(void *ptr, ArrayAllocator &allocator);
+
 
 private:
 
-    int m_rows;
-    int m_cols;
-    int m_allocSize;
-    int m_refCount;
+    static const Index InlineSize = Index(KSL_ARRAY_INLINE_BYTES / sizeof(Tp));
+    static const Index MaxSize = std::numeric_limits<Index>::max() / Index(sizeof(Tp));
+
+    static Index checkedSize(Index rows, Index cols);
+
+    // Room for the allocator in front of the block
+    static const std::size_t BlockPrefix;
+
+    Tp* inlineData() { return reinterpret_cast<Tp*>(m_inline); }
+    const Tp* inlineData() const { return reinterpret_cast<const Tp*>(m_inline); }
+    void grow(Index size);
+    void trackAlloc();
+    void trackRelease();
+
+    Index m_rows;
+    Index m_cols;
+    Index m_allocSize;
+    ArrayRefCount m_refCount;
     Tp *m_data;
+    ArrayAllocator *m_allocator;
+    ArrayBufferOwner *m_owner;
+    bool m_readOnly;
+    ArrayLayout m_layout;
+    // Subsystem charged for the buffer in MemoryStats, or -1
+    int m_statsSubsystem;
+    alignas(alignof(Tp) > 16 ? alignof(Tp) : 16)
+    unsigned char m_inline[KSL_ARRAY_INLINE_BYTES > 0 ? KSL_ARRAY_INLINE_BYTES : 1];
 };
 
 
 template <typename Tp>
-Array<0,Tp>::Array(int rows, int cols) {
+Array<0,Tp>::Array(Index rows, Index cols, ArrayAllocator &allocator) {
+    m_allocator = &allocator;
+    m_owner = nullptr;
+    m_readOnly = false;
+    m_layout = RowMajor;
+    m_statsSubsystem = -1;
     alloc(rows, cols);
-    m_refCount = 1;
 }
 
 
 template <typename Tp>
-Array<0,Tp>::Array(int rows, int cols, const Tp &initValue) {
+Array<0,Tp>::Array(Index rows, Index cols, const Tp &initValue,
+                   ArrayAllocator &allocator)
+{
+    m_allocator = &allocator;
+    m_owner = nullptr;
+    m_readOnly = false;
+    m_layout = RowMajor;
+    m_statsSubsystem = -1;
     alloc(rows, cols);
-    m_refCount = 1;
     for (auto &x : *this) {
         x = initValue;
     }
 }
 
 
+// Adopts a buffer of rows*cols elements. If the array
+// grows, the elements move to the current allocator
+template <typename Tp>
+Array<0,Tp>::Array(Index rows, Index cols, Tp *data,
+                   ArrayBufferOwner *owner, bool readOnly)
+{
+    m_allocator = &ArrayAllocator::current();
+    m_owner = owner;
+    m_readOnly = readOnly;
+    m_layout = RowMajor;
+    m_statsSubsystem = -1;
+    m_rows = (rows > 0 && cols > 0) ? rows : 0;
+    m_cols = (rows > 0 && cols > 0) ? cols : 0;
+    m_allocSize = m_rows*m_cols;
+    m_data = data;
+}
+
+
 template <typename Tp>
 Array<0,Tp>::~Array() {
     free();
@@ -110,55 +270,160 @@ Array<0,Tp>::~Array() {
 
 
 template <typename Tp>
-void Array<0,Tp>::alloc(int rows, int cols) {
+void Array<0,Tp>::alloc(Index rows, Index cols) {
     if (rows > 0 && cols > 0) {
         m_rows = rows;
         m_cols = cols;
-        m_allocSize = rows*cols;
-        m_data = (Tp*) std::malloc(
-            (std::size_t) m_allocSize *sizeof(Tp));
     } else {
         m_rows = 0;
         m_cols = 0;
-        m_allocSize = 0;
-        m_data = nullptr;
+    }
+    Index size = checkedSize(m_rows, m_cols);
+    if (size <= InlineSize) {
+        m_allocSize = InlineSize;
+        m_data = inlineData();
+    } else {
+        m_data = (Tp*) m_allocator->allocate(
+            (std::size_t) size *sizeof(Tp));
+        if (!m_data) {
+            throw std::bad_alloc();
+        }
+        m_allocSize = size;
+        trackAlloc();
+    }
+}
+
+
+template <typename Tp>
+void Array<0,Tp>::trackAlloc() {
+    if (MemoryStats::isEnabled()) {
+        m_statsSubsystem = MemoryStats::current();
+        MemoryStats::allocated(MemoryStats::Subsystem(m_statsSubsystem),
+                               qint64(m_allocSize)*qint64(sizeof(Tp)));
     }
 }
 
 
 template <typename Tp>
-void Array<0,Tp>::resize(int rows, int cols) {
+void Array<0,Tp>::trackRelease() {
+    if (m_statsSubsystem >= 0) {
+        MemoryStats::released(MemoryStats::Subsystem(m_statsSubsystem),
+                              qint64(m_allocSize)*qint64(sizeof(Tp)));
+        m_statsSubsystem = -1;
+    }
+}
+
+
+template <typename Tp>
+const std::size_t Array<0,Tp>::BlockPrefix =
+    alignof(Array<0,Tp>) > sizeof(void*) ? alignof(Array<0,Tp>) : sizeof(void*);
+
+
+template <typename Tp>
+void* Array<0,Tp>::operator new(std::size_t bytes) {
+    return operator new(bytes, ArrayAllocator::current());
+}
+
+
+template <typename Tp>
+void* Array<0,Tp>::operator new(std::size_t bytes, ArrayAllocator &allocator) {
+    ArrayAllocator *source = &allocator;
+    char *block = (char*) source->allocateStorage(bytes + BlockPrefix);
+    std::memcpy(block, &source, sizeof(source));
+    return block + BlockPrefix;
+}
+
+
+template <typename Tp>
+void Array<0,Tp>::operator delete(void *ptr, std::size_t bytes) {
+    if (!ptr) {
+        return;
+    }
+    char *block = (char*) ptr - BlockPrefix;
+    ArrayAllocator *allocator;
+    std::memcpy(&allocator, block, sizeof(allocator));
+    allocator->deallocateStorage(block, bytes + BlockPrefix);
+}
+
+
+// Called only when a constructor throws
+template <typename Tp>
+void Array<0,Tp>::operator delete(void *ptr, ArrayAllocator &allocator) {
+    Q_UNUSED(allocator)
+    operator delete(ptr, sizeof(Array<0,Tp>));
+}
+
+
+// Sizes are limited so that byte counts fit in an Index
+template <typename Tp>
+Index Array<0,Tp>::checkedSize(Index rows, Index cols) {
+    if (rows < 0 || cols < 0 ||
+        (cols > 0 && rows > MaxSize / cols))
+    {
+        throw std::bad_array_new_length();
+    }
+    return rows*cols;
+}
+
+
+template <typename Tp>
+void Array<0,Tp>::grow(Index size) {
+    Tp *data;
+    checkedSize(1, size);
+    if (isInline() || m_owner) {
+        // spill the inline or foreign elements to the heap
+        data = (Tp*) m_allocator->allocate(
+            (std::size_t) size *sizeof(Tp));
+        if (data) {
+            std::copy(begin(), end(), data);
+            delete m_owner;
+            m_owner = nullptr;
+            m_readOnly = false;
+        }
+    } else {
+        data = (Tp*) m_allocator->reallocate(
+            (void*) m_data,
+            (std::size_t) m_allocSize *sizeof(Tp),
+            (std::size_t) size *sizeof(Tp));
+    }
+    if (!data) {
+        throw std::bad_alloc();
+    }
+    trackRelease();
+    m_data = data;
+    m_allocSize = size;
+    trackAlloc();
+}
+
+
+template <typename Tp>
+void Array<0,Tp>::resize(Index rows, Index cols) {
     if (rows >= 0 && cols >= 0) {
+        Index size = checkedSize(rows, cols);
+        if (size > m_allocSize) {
+            grow(size);
+        }
         m_rows = rows;
         m_cols = cols;
-        if (rows*cols > m_allocSize) {
-            m_allocSize = rows*cols;
-            m_data = (Tp*) std::realloc(
-                (void*) m_data,
-                (std::size_t) m_allocSize *sizeof(Tp));
-        }
     }
 }
 
 
 template <typename Tp>
-void Array<0,Tp>::reserve(int size) {
+void Array<0,Tp>::reserve(Index size) {
     if (size > m_allocSize) {
-        if (m_rows == 0) m_rows = 1;
-        m_allocSize = size;
-        m_data = (Tp*) std::realloc(
-            (void*) m_data,
-            (std::size_t) m_allocSize *sizeof(Tp));
+        grow(size);
     }
 }
 
 
 template <typename Tp>
 void Array<0,Tp>::append(const Tp &value) {
-    if (m_allocSize == 0) {
-        reserve(12);
-    } else if (m_allocSize == size()) {
-        reserve(4*size()/3);
+    if (m_rows == 0) {
+        m_rows = 1;
+    }
+    if (m_allocSize == size()) {
+        reserve(m_allocSize < 12 ? 12 : m_allocSize + m_allocSize/3);
     }
     valueAt(size()) = value;
     m_cols += 1;
@@ -167,8 +432,14 @@ void Array<0,Tp>::append(const Tp &value) {
 
 template <typename Tp>
 void Array<0,Tp>::free() {
-    if (m_data) {
-        std::free(m_data);
+    if (m_owner) {
+        delete m_owner;
+        m_owner = nullptr;
+    } else if (m_data && !isInline()) {
+        trackRelease();
+        m_allocator->deallocate(
+            (void*) m_data,
+            (std::size_t) m_allocSize *sizeof(Tp));
     }
     m_data = nullptr;
     m_rows = 0;
@@ -177,17 +448,25 @@ void Array<0,Tp>::free() {
 }
 
 
+template <typename Tp>
+Array<0,Tp>* Array<0,Tp>::clone() const {
+    auto ret = new (*m_allocator) Array<0,Tp>(m_rows, m_cols, *m_allocator);
+    ret->m_layout = m_layout;
+    std::copy(begin(), end(), ret->begin());
+    return ret;
+}
+
+
 template <typename Tp>
 Array<0,Tp>* Array<0,Tp>::ref() {
-    m_refCount += 1;
+    m_refCount.ref();
     return this;
 }
 
 
 template <typename Tp>
 bool Array<0,Tp>::unref() {
-    m_refCount -= 1;
-    return (m_refCount == 0);
+    return m_refCount.unref();
 }
 
 
@@ -198,15 +477,55 @@ operator== (const Array<0,Tp> &v1, const Array<0,Tp> &v2) {
     {
         return false;
     }
-    for (int k=0; k<v1.size(); ++k) {
-        if (v1.valueAt(k) != v2.valueAt(k)) {
-            return false;
+    if (v1.layout() == v2.layout()) {
+        return std::equal(v1.begin(), v1.end(), v2.begin());
+    }
+    for (Index i=0; i<v1.rows(); ++i) {
+        for (Index j=0; j<v1.cols(); ++j) {
+            if (v1.valueAt(v1.offsetOf(i,j)) != v2.valueAt(v2.offsetOf(i,j))) {
+                return false;
+            }
         }
     }
     return true;
 }
 
 
+// Storage over an outside buffer, released through the
+// callback. Empty shapes release the buffer at once
+template <typename Tp> inline Array<0,Tp>*
+wrapStorage(Tp *data, Index rows, Index cols,
+            const std::function<void(Tp*)> &release, bool readOnly)
+{
+    if (rows <= 0 || cols <= 0) {
+        if (release) {
+            release(data);
+        }
+        return nullptr;
+    }
+    ArrayBufferReleaser *owner;
+    try {
+        std::function<void()> releaseData;
+        if (release) {
+            releaseData = std::bind(release, data);
+        }
+        owner = new ArrayBufferReleaser(releaseData);
+    } catch (...) {
+        // nobody owns the buffer yet
+        if (release) {
+            release(data);
+        }
+        throw;
+    }
+    try {
+        return new Array<0,Tp>(rows, cols, data, owner, readOnly);
+    } catch (...) {
+        delete owner;
+        throw;
+    }
+}
+
+
 /*********************************************
  * This the 1D (vector) array
  *********************************************/
@@ -214,47 +533,81 @@ template <typename Tp>
 class Array<1,Tp>
 {
 public:
+
+    typedef Tp value_type;
     
-    Array(int size=0);
-    Array(int size, const Tp &initValue);
+    Array(Index size=0);
+    Array(Index size, const Tp &initValue);
+    Array(Index size, ArrayAllocator &allocator);
+    Array(Index size, const Tp &initValue, ArrayAllocator &allocator);
+    Array(Tp *data, Index size, const std::function<void(Tp*)> &release,
+          bool readOnly=false);
     Array(const Array &that);
     Array(Array &&that);
+    explicit Array(Array<0,Tp> *storage);
     Array(std::initializer_list<Tp> initList);
+    template <typename E> Array(const ArrayExpr<E> &expr);
     ~Array();
 
     Array& operator= (const Array &that);
     Array& operator= (Array &&that);
+    template <typename E> Array& operator= (const ArrayExpr<E> &expr);
+
+    template <typename R> Array& operator+= (const R &that);
+    template <typename R> Array& operator-= (const R &that);
+    template <typename R> Array& operator*= (const R &that);
+    template <typename R> Array& operator/= (const R &that);
     
-    int size() const { return m_data ? m_data->cols() : 0; }
-    int capacity() const { return m_data ? m_data->capacity() : 0; }
+    Index size() const { return m_data ? m_data->cols() : 0; }
+    Index capacity() const { return m_data ? m_data->capacity() : 0; }
     
-    Tp& operator[] (int idx) { return m_data->valueAt(idx); }
-    const Tp& operator[] (int idx) const { return m_data->valueAt(idx); }
+    // The non-const accessors detach, so even reading through a
+    // shared or read-only array copies the whole buffer, and each
+    // call pays an atomic load. Loops should take begin() once, or
+    // read through a const reference
+    Tp& operator[] (Index idx) { detach(); return m_data->valueAt(idx); }
+    const Tp& operator[] (Index idx) const { return m_data->valueAt(idx); }
     
-    Tp& at(int idx) { return m_data->valueAt(idx); }
-    const Tp& at(int idx) const { return m_data->valueAt(idx); }
+    Tp& at(Index idx) { detach(); return m_data->valueAt(idx); }
+    const Tp& at(Index idx) const { return m_data->valueAt(idx); }
     
-    Tp* begin() { return m_data ? m_data->begin() : nullptr; }
+    Tp* begin() { detach(); return m_data ? m_data->begin() : nullptr; }
     const Tp* begin() const { return m_data ? m_data->begin() : nullptr; }
     
-    Tp* end() { return m_data ? m_data->end() : nullptr; }
+    Tp* end() { detach(); return m_data ? m_data->end() : nullptr; }
     const Tp* end() const { return m_data ? m_data->end() : nullptr; }
     
-    Array<0,Tp>* storage() { return m_data; }
+    Array<0,Tp>* storage() { detach(); return m_data; }
     const Array<0,Tp>* storage() const { return m_data; }
     
+    void detach();
+    bool isDetached() const {
+        return !m_data || (m_data->refCount() == 1 && !m_data->isReadOnly());
+    }
+    
     void append(const Tp &value);
     void push(const Tp &value);
     void pop();
 
+    // Zero-copy view of the elements start,
+    // start+step, ... before stop
+    ArrayView<Tp> operator() (Index start, Index stop, Index step=1) const;
+
 private:
-    
+
+    // Both have storage, from different allocators.
+    // Assignment copies then, so arrays keep theirs
+    bool hasOtherAllocator(const Array &that) const {
+        return m_data && that.m_data &&
+            &m_data->allocator() != &that.m_data->allocator();
+    }
+
     Array<0,Tp> *m_data;
 };
 
 
 template <typename Tp>
-Array<1,Tp>::Array(int size) {
+Array<1,Tp>::Array(Index size) {
     if (size > 0) {
         m_data = new Array<0,Tp>(1, size);
     } else {
@@ -264,7 +617,7 @@ Array<1,Tp>::Array(int size) {
 
 
 template <typename Tp>
-Array<1,Tp>::Array(int size, const Tp &initValue) {
+Array<1,Tp>::Array(Index size, const Tp &initValue) {
     if (size > 0) {
         m_data = new Array<0,Tp>(1, size, initValue);
     } else {
@@ -274,9 +627,9 @@ Array<1,Tp>::Array(int size, const Tp &initValue) {
 
 
 template <typename Tp>
-Array<1,Tp>::Array(const Array<1,Tp> &that) {
-    if (that.m_data) {
-        m_data = that.m_data->ref();
+Array<1,Tp>::Array(Index size, ArrayAllocator &allocator) {
+    if (size > 0) {
+        m_data = new (allocator) Array<0,Tp>(1, size, allocator);
     } else {
         m_data = nullptr;
     }
@@ -284,7 +637,33 @@ Array<1,Tp>::Array(const Array<1,Tp> &that) {
 
 
 template <typename Tp>
-Array<1,Tp>::Array(Array<1,Tp> &&that) {
+Array<1,Tp>::Array(Index size, const Tp &initValue,
+                   ArrayAllocator &allocator)
+{
+    if (size > 0) {
+        m_data = new (allocator) Array<0,Tp>(1, size, initValue, allocator);
+    } else {
+        m_data = nullptr;
+    }
+}
+
+
+// Wraps a buffer of "size" elements that the caller
+// already filled, without copying it. "release" gets
+// the buffer when the last array using it goes away,
+// or when an array outgrows it. Read only buffers are
+// copied before the first write
+template <typename Tp>
+Array<1,Tp>::Array(Tp *data, Index size,
+                   const std::function<void(Tp*)> &release,
+                   bool readOnly)
+{
+    m_data = wrapStorage(data, 1, size, release, readOnly);
+}
+
+
+template <typename Tp>
+Array<1,Tp>::Array(const Array<1,Tp> &that) {
     if (that.m_data) {
         m_data = that.m_data->ref();
     } else {
@@ -293,6 +672,20 @@ Array<1,Tp>::Array(Array<1,Tp> &&that) {
 }
 
 
+template <typename Tp>
+Array<1,Tp>::Array(Array<1,Tp> &&that) {
+    m_data = that.m_data;
+    that.m_data = nullptr;
+}
+
+
+// Takes over a new storage, nobody else may refer to it
+template <typename Tp>
+Array<1,Tp>::Array(Array<0,Tp> *storage) {
+    m_data = storage;
+}
+
+
 template <typename Tp>
 Array<1,Tp>::Array(std::initializer_list<Tp> initList) {
     if (initList.size() > 0) {
@@ -307,6 +700,18 @@ Array<1,Tp>::Array(std::initializer_list<Tp> initList) {
 }
 
 
+template <typename Tp> template <typename E>
+Array<1,Tp>::Array(const ArrayExpr<E> &expr) {
+    const E &e = expr.self();
+    if (e.size() > 0) {
+        m_data = new Array<0,Tp>(1, e.size());
+        evaluate(m_data->begin(), e, e.size());
+    } else {
+        m_data = nullptr;
+    }
+}
+
+
 template <typename Tp>
 Array<1,Tp>::~Array() {
     if (m_data) {
@@ -320,6 +725,9 @@ Array<1,Tp>::~Array() {
 template <typename Tp> Array<1,Tp>&
 Array<1,Tp>::operator= (const Array<1,Tp> &that) {
     if (m_data != that.m_data) {
+        if (hasOtherAllocator(that)) {
+            return *this = ArrayRef<1,Tp>(that.begin(), 1, that.size());
+        }
         if (m_data) {
             if (m_data->unref()) {
                 delete m_data;
@@ -337,18 +745,93 @@ Array<1,Tp>::operator= (const Array<1,Tp> &that) {
 
 template <typename Tp> Array<1,Tp>&
 Array<1,Tp>::operator= (Array<1,Tp> &&that) {
-    if (m_data != that.m_data) {
+    if (this != &that) {
+        if (hasOtherAllocator(that)) {
+            const Array<1,Tp> &source = that;
+            return *this = ArrayRef<1,Tp>(source.begin(), 1, source.size());
+        }
         if (m_data) {
             if (m_data->unref()) {
                 delete m_data;
             }
         }
-        if (that.m_data) {
-            m_data = that.m_data->ref();
-        } else {
-            m_data = nullptr;
+        m_data = that.m_data;
+        that.m_data = nullptr;
+    }
+    return *this;
+}
+
+
+template <typename Tp>
+void Array<1,Tp>::detach() {
+    if (m_data && !isDetached()) {
+        auto copy = m_data->clone();
+        if (m_data->unref()) {
+            delete m_data;
         }
+        m_data = copy;
     }
+}
+
+
+template <typename Tp> template <typename E> Array<1,Tp>&
+Array<1,Tp>::operator= (const ArrayExpr<E> &expr) {
+    const E &e = expr.self();
+    // Reuse our buffer only if no one else can see it
+    if (m_data && isDetached() && size() == e.size()) {
+        evaluate(m_data->begin(), e, e.size());
+    } else if (m_data) {
+        // a new buffer keeps our allocator, not the current one
+        Array<1,Tp> result(e.size(), m_data->allocator());
+        if (result.m_data) {
+            evaluate(result.m_data->begin(), e, e.size());
+        }
+        *this = std::move(result);
+    } else {
+        *this = Array<1,Tp>(expr);
+    }
+    return *this;
+}
+
+
+template <typename Tp> template <typename R>
+Array<1,Tp>& Array<1,Tp>::operator+= (const R &that) {
+    const auto &e = ArrayOperand<R>::make(that);
+    checkShape(ArrayRef<1,Tp>(nullptr, 1, size()), e);
+    // "that" may read our buffer, which detaching releases
+    // when it was read only, keep it until we are done
+    Array<1,Tp> previous = isDetached() ? Array<1,Tp>() : *this;
+    evaluate(begin(), e, size(), ArrayAddOp());
+    return *this;
+}
+
+
+template <typename Tp> template <typename R>
+Array<1,Tp>& Array<1,Tp>::operator-= (const R &that) {
+    const auto &e = ArrayOperand<R>::make(that);
+    checkShape(ArrayRef<1,Tp>(nullptr, 1, size()), e);
+    Array<1,Tp> previous = isDetached() ? Array<1,Tp>() : *this;
+    evaluate(begin(), e, size(), ArraySubOp());
+    return *this;
+}
+
+
+template <typename Tp> template <typename R>
+Array<1,Tp>& Array<1,Tp>::operator*= (const R &that) {
+    const auto &e = ArrayOperand<R>::make(that);
+    checkShape(ArrayRef<1,Tp>(nullptr, 1, size()), e);
+    Array<1,Tp> previous = isDetached() ? Array<1,Tp>() : *this;
+    evaluate(begin(), e, size(), ArrayMulOp());
+    return *this;
+}
+
+
+template <typename Tp> template <typename R>
+Array<1,Tp>& Array<1,Tp>::operator/= (const R &that) {
+    const auto &e = ArrayOperand<R>::make(that);
+    checkShape(ArrayRef<1,Tp>(nullptr, 1, size()), e);
+    Array<1,Tp> previous = isDetached() ? Array<1,Tp>() : *this;
+    evaluate(begin(), e, size(), ArrayDivOp());
     return *this;
 }
 
@@ -358,6 +841,7 @@ void Array<1,Tp>::append(const Tp &value) {
     if (!m_data) {
         m_data = new Array<0,Tp>(0,0);
     }
+    detach();
     m_data->append(value);
 }
 
@@ -371,6 +855,7 @@ void Array<1,Tp>::push(const Tp &value) {
 template <typename Tp>
 void Array<1,Tp>::pop() {
     if (m_data) {
+        detach();
         m_data->resize(1, size()-1);
     }
 }
@@ -378,9 +863,9 @@ void Array<1,Tp>::pop() {
 
 template <typename Tp> inline std::ostream&
 operator<< (std::ostream &out, const Array<1,Tp> &array) {
-    int n = array.size() - 1;
+    Index n = array.size() - 1;
     out << '[';
-    for (int k=0; k<n; ++k) {
+    for (Index k=0; k<n; ++k) {
         out << array[k] << ", ";
     }
     if (n >= 0) out << array[n] << ']';
@@ -389,58 +874,219 @@ operator<< (std::ostream &out, const Array<1,Tp> &array) {
 }
 
 
+// Length of the slice start, start+step, ... before stop
+// of a sequence of "size" elements. Clamps start and stop
+// to [0, size], the step must be positive
+inline Index sliceSize(Index size, Index &start, Index stop, Index step) {
+    if (step <= 0) {
+        throw std::invalid_argument("Ksl: slice step must be positive");
+    }
+    start = std::max(Index(0), std::min(start, size));
+    stop = std::min(stop, size);
+    return (stop > start) ? (stop - start + step - 1)/step : 0;
+}
+
+
+/*********************************************
+ * Lazy arithmetic sequence start + k*step of
+ * "size" elements. It has the read interface
+ * of ArrayView but no storage, elements are
+ * computed when read, so a sample axis costs
+ * nothing and maps positions to indexes in
+ * O(1). Plots recognize it and map x without
+ * reading memory.
+ *********************************************/
+template <typename Tp>
+class ArrayRange
+{
+public:
+
+    typedef Tp value_type;
+
+    class const_iterator
+    {
+    public:
+
+        typedef std::random_access_iterator_tag iterator_category;
+        typedef Tp value_type;
+        typedef Index difference_type;
+        typedef const Tp* pointer;
+        typedef Tp reference;
+
+        const_iterator(const ArrayRange *range=nullptr, Index idx=0)
+            : m_range(range), m_idx(idx)
+        { }
+
+        Tp operator* () const { return (*m_range)[m_idx]; }
+        Tp operator[] (Index n) const { return (*m_range)[m_idx + n]; }
+
+        const_iterator& operator++ () { ++m_idx; return *this; }
+        const_iterator& operator-- () { --m_idx; return *this; }
+        const_iterator operator++ (int) { auto ret = *this; ++m_idx; return ret; }
+        const_iterator operator-- (int) { auto ret = *this; --m_idx; return ret; }
+
+        const_iterator& operator+= (Index n) { m_idx += n; return *this; }
+        const_iterator& operator-= (Index n) { m_idx -= n; return *this; }
+        const_iterator operator+ (Index n) const { return const_iterator(m_range, m_idx + n); }
+        const_iterator operator- (Index n) const { return const_iterator(m_range, m_idx - n); }
+        Index operator- (const const_iterator &that) const { return m_idx - that.m_idx; }
+
+        bool operator== (const const_iterator &that) const { return m_idx == that.m_idx; }
+        bool operator!= (const const_iterator &that) const { return m_idx != that.m_idx; }
+        bool operator< (const const_iterator &that) const { return m_idx < that.m_idx; }
+        bool operator> (const const_iterator &that) const { return m_idx > that.m_idx; }
+        bool operator<= (const const_iterator &that) const { return m_idx <= that.m_idx; }
+        bool operator>= (const const_iterator &that) const { return m_idx >= that.m_idx; }
+
+    private:
+
+        const ArrayRange *m_range;
+        Index m_idx;
+    };
+
+
+    ArrayRange()
+        : m_start(0), m_step(0), m_size(0)
+    { }
+
+    ArrayRange(const Tp &start, const Tp &step, Index size)
+        : m_start(start), m_step(step), m_size(size > 0 ? size : 0)
+    { }
+
+    // num elements from start to stop, both included
+    static ArrayRange linspace(const Tp &start, const Tp &stop, Index num) {
+        Tp step = (num > 1) ? Tp((stop - start) / Tp(num - 1)) : Tp(0);
+        return ArrayRange(start, step, num);
+    }
+
+    // From start, before stop, every step
+    static ArrayRange arange(const Tp &start, const Tp &stop, const Tp &step=Tp(1)) {
+        double num = (step != Tp(0)) ? std::ceil(double(stop - start) / double(step)) : 0.0;
+        return ArrayRange(start, step, num > 0.0 ? Index(num) : 0);
+    }
+
+    Index size() const { return m_size; }
+    const Tp& start() const { return m_start; }
+    const Tp& step() const { return m_step; }
+
+    Tp operator[] (Index idx) const { return m_start + Tp(idx)*m_step; }
+
+    // Index of the last element not past value, in the
+    // direction of step, clamped to [-1, size]
+    Index indexAt(const Tp &value) const {
+        if (m_step == Tp(0)) {
+            return 0;
+        }
+        double idx = std::floor(double(value - m_start) / double(m_step));
+        if (!(idx >= -1.0)) {
+            return -1;
+        }
+        return (idx < double(m_size)) ? Index(idx) : m_size;
+    }
+
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, m_size); }
+
+    // Elements start, start+step, ... before stop, see
+    // sliceSize(). Throws std::invalid_argument if step <= 0
+    ArrayRange operator() (Index start, Index stop, Index step=1) const {
+        Index size = sliceSize(m_size, start, stop, step);
+        return ArrayRange((*this)[start], m_step*Tp(step), size);
+    }
+
+
+private:
+
+    Tp m_start;
+    Tp m_step;
+    Index m_size;
+};
+
+
 /*********************************************
  * 1D array creation functions
  *********************************************/
 
 
 template <typename Tp=double>
-inline Array<1,Tp> zeros(int size) {
-    return std::move(Array<1,Tp>(size, Tp(0)));
+inline Array<1,Tp> zeros(Index size) {
+    return Array<1,Tp>(size, Tp(0));
 }
 
 
 template <typename Tp=double>
-inline Array<1,Tp> ones(int size) {
-    return std::move(Array<1,Tp>(size, Tp(1)));
+inline Array<1,Tp> ones(Index size) {
+    return Array<1,Tp>(size, Tp(1));
 }
 
 
+template <typename Tp> inline
+Array<1,Tp> copy(const ArrayRange<Tp> &range) {
+    Array<1,Tp> ret(range.size());
+    std::copy(range.begin(), range.end(), ret.begin());
+    return ret;
+}
+
+
+// Materialized versions of ArrayRange::linspace() and
+// ArrayRange::arange(), with numpy's conventions
 template <typename Tp=double> inline Array<1,Tp>
-linspace(const Tp &start, const Tp &stop, int num) {
-    Array<1,Tp> ret(num);
-    auto step = (stop-start) / num;
-    for (int k=0; k<num; ++k) {
-        ret[k] = k * step;
-    }
-    return std::move(ret);
+linspace(const Tp &start, const Tp &stop, Index num) {
+    return copy(ArrayRange<Tp>::linspace(start, stop, num));
 }
 
 
 template <typename Tp=double> inline Array<1,Tp>
 arange(const Tp &start, const Tp &stop, const Tp &step=Tp(1)) {
-    int num = int((stop - start) / step) + 1;
-    Array<1,Tp> ret(num);
-    for (int k=0; k<num; ++k) {
-        ret[k] = k * step;
+    return copy(ArrayRange<Tp>::arange(start, stop, step));
+}
+
+
+inline void randomFill(Random &rng, double *dest, Index size, double max) {
+    rng.fillUniform(dest, size, 0.0, max);
+}
+
+template <typename Tp> inline
+void randomFill(Random &rng, Tp *dest, Index size, const Tp &max) {
+    for (Index k=0; k<size; ++k) {
+        dest[k] = Tp(max * rng.uniform());
     }
-    return std::move(ret);
 }
 
 
+// Uniform in [0,max), from the generator of the thread
+// unless one is given
 template <typename Tp=double> inline
-Array<1,Tp> randspace(int size, const Tp &max=Tp(1)) {
+Array<1,Tp> randspace(Index size, const Tp &max=Tp(1),
+                      Random &rng=Random::local())
+{
     Array<1,Tp> ret(size);
-    for (int k=0; k<size; ++k) {
-        ret[k] = Tp(max * double(std::rand())/RAND_MAX);
-    }
-    return std::move(ret);
+    randomFill(rng, ret.begin(), size, max);
+    return ret;
+}
+
+
+inline Array<1> randn(Index size, double mean=0.0, double sigma=1.0,
+                      Random &rng=Random::local())
+{
+    Array<1> ret(size);
+    rng.fillNormal(ret.begin(), size, mean, sigma);
+    return ret;
+}
+
+
+inline Array<1> randexp(Index size, double lambda=1.0,
+                        Random &rng=Random::local())
+{
+    Array<1> ret(size);
+    rng.fillExponential(ret.begin(), size, lambda);
+    return ret;
 }
 
 
 template <typename Tp> inline
 Array<1,Tp> samesize(const Array<1,Tp> &other) {
-    return std::move(Array<1,Tp>(other.size()));
+    return Array<1,Tp>(other.size());
 }
 
 
@@ -451,44 +1097,80 @@ template <typename Tp>
 class Array<2,Tp>
 {
 public:
+
+    typedef Tp value_type;
     
-    Array(int rows=0, int cols=0);
-    Array(int rows, int cols, const Tp &initValue);
+    Array(Index rows=0, Index cols=0);
+    Array(Index rows, Index cols, const Tp &initValue);
+    Array(Index rows, Index cols, ArrayAllocator &allocator);
+    Array(Index rows, Index cols, const Tp &initValue, ArrayAllocator &allocator);
+    Array(Index rows, Index cols, ArrayLayout layout);
+    Array(Index rows, Index cols, const Tp &initValue, ArrayLayout layout);
+    Array(Tp *data, Index rows, Index cols,
+          const std::function<void(Tp*)> &release,
+          ArrayLayout layout=RowMajor, bool readOnly=false);
     Array(const Array &that);
     Array(Array &&that);
+    explicit Array(Array<0,Tp> *storage);
+    template <typename E> Array(const ArrayExpr<E> &expr);
     ~Array();
 
     Array& operator= (const Array &that);
     Array& operator= (Array &&that);
+    template <typename E> Array& operator= (const ArrayExpr<E> &expr);
+
+    template <typename R> Array& operator+= (const R &that);
+    template <typename R> Array& operator-= (const R &that);
+    template <typename R> Array& operator*= (const R &that);
+    template <typename R> Array& operator/= (const R &that);
+    
+    Index rows() const { return m_data ? m_data->rows() : 0; }
+    Index cols() const { return m_data ? m_data->cols() : 0; }
+    Index size() const { return m_data ? m_data->size() : 0; }
+    ArrayLayout layout() const { return m_data ? m_data->layout() : RowMajor; }
     
-    int rows() const { return m_data ? m_data->rows() : 0; }
-    int cols() const { return m_data ? m_data->cols() : 0; }
-    int size() const { return m_data ? m_data->size() : 0; }
+    // As for vectors, the non-const accessors detach, see Array<1>
     
-    Tp* operator[] (int idx) { return m_data->rowAt(idx); }
-    const Tp* operator[] (int idx) const { return m_data->rowAt(idx); }
+    // Row idx, or column idx if the matrix is column major
+    Tp* operator[] (Index idx) { detach(); return m_data->lineAt(idx); }
+    const Tp* operator[] (Index idx) const { return m_data->lineAt(idx); }
+
+    Tp& operator() (Index i, Index j) { detach(); return m_data->valueAt(m_data->offsetOf(i,j)); }
+    const Tp& operator() (Index i, Index j) const { return m_data->valueAt(m_data->offsetOf(i,j)); }
     
-    Tp& at(int idx) { return m_data->valueAt(idx); }
-    const Tp& at(int idx) const { return m_data->valueAt(idx); }
+    Tp& at(Index idx) { detach(); return m_data->valueAt(idx); }
+    const Tp& at(Index idx) const { return m_data->valueAt(idx); }
     
-    Tp* begin() { return m_data ? m_data->begin() : nullptr; }
+    Tp* begin() { detach(); return m_data ? m_data->begin() : nullptr; }
     const Tp* begin() const { return m_data ? m_data->begin() : nullptr; }
     
-    Tp* end() { return m_data ? m_data->end() : nullptr; }
+    Tp* end() { detach(); return m_data ? m_data->end() : nullptr; }
     const Tp* end() const { return m_data ? m_data->end() : nullptr; }
     
-    Array<0,Tp>* storage() { return m_data; }
+    Array<0,Tp>* storage() { detach(); return m_data; }
     const Array<0,Tp>* storage() const { return m_data; }
+    
+    void detach();
+    bool isDetached() const {
+        return !m_data || (m_data->refCount() == 1 && !m_data->isReadOnly());
+    }
 
 
 private:
-    
+
+    // Both have storage, from different allocators.
+    // Assignment copies then, so arrays keep theirs
+    bool hasOtherAllocator(const Array &that) const {
+        return m_data && that.m_data &&
+            &m_data->allocator() != &that.m_data->allocator();
+    }
+
     Array<0,Tp> *m_data;
 };
 
 
 template <typename Tp>
-Array<2,Tp>::Array(int rows, int cols) {
+Array<2,Tp>::Array(Index rows, Index cols) {
     if (rows > 0 && cols > 0) {
         m_data = new Array<0,Tp>(rows, cols);
     } else {
@@ -498,7 +1180,7 @@ Array<2,Tp>::Array(int rows, int cols) {
 
 
 template <typename Tp>
-Array<2,Tp>::Array(int rows, int cols, const Tp &initValue) {
+Array<2,Tp>::Array(Index rows, Index cols, const Tp &initValue) {
     if (rows > 0 && cols > 0) {
         m_data = new Array<0,Tp>(rows, cols, initValue);
     } else {
@@ -507,6 +1189,63 @@ Array<2,Tp>::Array(int rows, int cols, const Tp &initValue) {
 }
 
 
+template <typename Tp>
+Array<2,Tp>::Array(Index rows, Index cols, ArrayAllocator &allocator) {
+    if (rows > 0 && cols > 0) {
+        m_data = new (allocator) Array<0,Tp>(rows, cols, allocator);
+    } else {
+        m_data = nullptr;
+    }
+}
+
+
+template <typename Tp>
+Array<2,Tp>::Array(Index rows, Index cols, const Tp &initValue,
+                   ArrayAllocator &allocator)
+{
+    if (rows > 0 && cols > 0) {
+        m_data = new (allocator) Array<0,Tp>(rows, cols, initValue, allocator);
+    } else {
+        m_data = nullptr;
+    }
+}
+
+
+template <typename Tp>
+Array<2,Tp>::Array(Index rows, Index cols, ArrayLayout layout)
+    : Array(rows, cols)
+{
+    if (m_data) {
+        m_data->setLayout(layout);
+    }
+}
+
+
+template <typename Tp>
+Array<2,Tp>::Array(Index rows, Index cols, const Tp &initValue,
+                   ArrayLayout layout)
+    : Array(rows, cols, initValue)
+{
+    if (m_data) {
+        m_data->setLayout(layout);
+    }
+}
+
+
+// Wraps a rows*cols buffer without copying it,
+// see the Array<1> version
+template <typename Tp>
+Array<2,Tp>::Array(Tp *data, Index rows, Index cols,
+                   const std::function<void(Tp*)> &release,
+                   ArrayLayout layout, bool readOnly)
+{
+    m_data = wrapStorage(data, rows, cols, release, readOnly);
+    if (m_data) {
+        m_data->setLayout(layout);
+    }
+}
+
+
 template <typename Tp>
 Array<2,Tp>::Array(const Array<2,Tp> &that) {
     if (that.m_data) {
@@ -519,8 +1258,26 @@ Array<2,Tp>::Array(const Array<2,Tp> &that) {
 
 template <typename Tp>
 Array<2,Tp>::Array(Array<2,Tp> &&that) {
-    if (that.m_data) {
-        m_data = that.m_data->ref();
+    m_data = that.m_data;
+    that.m_data = nullptr;
+}
+
+
+// Takes over a new storage, nobody else may refer to it
+template <typename Tp>
+Array<2,Tp>::Array(Array<0,Tp> *storage) {
+    m_data = storage;
+}
+
+
+template <typename Tp> template <typename E>
+Array<2,Tp>::Array(const ArrayExpr<E> &expr) {
+    const E &e = expr.self();
+    int layout = checkedLayout(e.layout());
+    if (e.rows() > 0 && e.cols() > 0) {
+        m_data = new Array<0,Tp>(e.rows(), e.cols());
+        m_data->setLayout(layout == ColumnMajor ? ColumnMajor : RowMajor);
+        evaluate(m_data->begin(), e, e.size());
     } else {
         m_data = nullptr;
     }
@@ -540,6 +1297,9 @@ Array<2,Tp>::~Array() {
 template <typename Tp> Array<2,Tp>&
 Array<2,Tp>::operator= (const Array<2,Tp> &that) {
     if (m_data != that.m_data) {
+        if (hasOtherAllocator(that)) {
+            return *this = ArrayRef<2,Tp>(that.begin(), that.rows(), that.cols(), that.layout());
+        }
         if (m_data) {
             if (m_data->unref()) {
                 delete m_data;
@@ -557,33 +1317,117 @@ Array<2,Tp>::operator= (const Array<2,Tp> &that) {
 
 template <typename Tp> Array<2,Tp>&
 Array<2,Tp>::operator= (Array<2,Tp> &&that) {
-    if (m_data != that.m_data) {
+    if (this != &that) {
+        if (hasOtherAllocator(that)) {
+            const Array<2,Tp> &source = that;
+            return *this = ArrayRef<2,Tp>(source.begin(), source.rows(), source.cols(), source.layout());
+        }
         if (m_data) {
             if (m_data->unref()) {
                 delete m_data;
             }
         }
-        if (that.m_data) {
-            m_data = that.m_data->ref();
-        } else {
-            m_data = nullptr;
+        m_data = that.m_data;
+        that.m_data = nullptr;
+    }
+    return *this;
+}
+
+
+template <typename Tp>
+void Array<2,Tp>::detach() {
+    if (m_data && !isDetached()) {
+        auto copy = m_data->clone();
+        if (m_data->unref()) {
+            delete m_data;
         }
+        m_data = copy;
+    }
+}
+
+
+template <typename Tp> template <typename E> Array<2,Tp>&
+Array<2,Tp>::operator= (const ArrayExpr<E> &expr) {
+    const E &e = expr.self();
+    // Reuse our buffer only if no one else can see it
+    if (m_data && isDetached() &&
+        rows() == e.rows() && cols() == e.cols() &&
+        combineLayouts(layout(), e.layout()) == layout())
+    {
+        evaluate(m_data->begin(), e, e.size());
+    } else if (m_data) {
+        // a new buffer keeps our allocator, not the current one
+        int layout = checkedLayout(e.layout());
+        Array<2,Tp> result(e.rows(), e.cols(), m_data->allocator());
+        if (result.m_data) {
+            result.m_data->setLayout(layout == ColumnMajor ? ColumnMajor : RowMajor);
+            evaluate(result.m_data->begin(), e, e.size());
+        }
+        *this = std::move(result);
+    } else {
+        *this = Array<2,Tp>(expr);
     }
     return *this;
 }
 
 
+template <typename Tp> template <typename R>
+Array<2,Tp>& Array<2,Tp>::operator+= (const R &that) {
+    const auto &e = ArrayOperand<R>::make(that);
+    checkedLayout(combineLayouts(layout(), e.layout()));
+    checkShape(ArrayRef<2,Tp>(nullptr, rows(), cols()), e);
+    // "that" may read our buffer, which detaching releases
+    // when it was read only, keep it until we are done
+    Array<2,Tp> previous = isDetached() ? Array<2,Tp>() : *this;
+    evaluate(begin(), e, size(), ArrayAddOp());
+    return *this;
+}
+
+
+template <typename Tp> template <typename R>
+Array<2,Tp>& Array<2,Tp>::operator-= (const R &that) {
+    const auto &e = ArrayOperand<R>::make(that);
+    checkedLayout(combineLayouts(layout(), e.layout()));
+    checkShape(ArrayRef<2,Tp>(nullptr, rows(), cols()), e);
+    Array<2,Tp> previous = isDetached() ? Array<2,Tp>() : *this;
+    evaluate(begin(), e, size(), ArraySubOp());
+    return *this;
+}
+
+
+template <typename Tp> template <typename R>
+Array<2,Tp>& Array<2,Tp>::operator*= (const R &that) {
+    const auto &e = ArrayOperand<R>::make(that);
+    checkedLayout(combineLayouts(layout(), e.layout()));
+    checkShape(ArrayRef<2,Tp>(nullptr, rows(), cols()), e);
+    Array<2,Tp> previous = isDetached() ? Array<2,Tp>() : *this;
+    evaluate(begin(), e, size(), ArrayMulOp());
+    return *this;
+}
+
+
+template <typename Tp> template <typename R>
+Array<2,Tp>& Array<2,Tp>::operator/= (const R &that) {
+    const auto &e = ArrayOperand<R>::make(that);
+    checkedLayout(combineLayouts(layout(), e.layout()));
+    checkShape(ArrayRef<2,Tp>(nullptr, rows(), cols()), e);
+    Array<2,Tp> previous = isDetached() ? Array<2,Tp>() : *this;
+    evaluate(begin(), e, size(), ArrayDivOp());
+    return *this;
+}
+
+
 template <typename Tp> inline std::ostream&
 operator<< (std::ostream &out, const Array<2,Tp> &array) {
-    int m = array.rows();
-    int n = array.cols() - 1;
+    Index m = array.rows();
+    Index n = array.cols() - 1;
     out << "[[";
-    for (int i=0; i<m; ++i) {
+    for (Index i=0; i<m; ++i) {
         if (i != 0) out << " [";
-        for (int j=0; j<n; ++j) {
-            out << array[i][j] << ", ";
+        for (Index j=0; j<n; ++j) {
+            out << array(i,j) << ", ";
         }
-        if (n >= 0) out << array[i][n];
+        if (n >= 0) out << array(i,n);
         if (i < (m-1)) out << ']' << std::endl;
     }
     out << "]]";
@@ -597,36 +1441,36 @@ operator<< (std::ostream &out, const Array<2,Tp> &array) {
 
 
 template <typename Tp=double>
-inline Array<2,Tp> zeros(int rows, int cols) {
-    return std::move(Array<2,Tp>(rows, cols, Tp(0)));
+inline Array<2,Tp> zeros(Index rows, Index cols) {
+    return Array<2,Tp>(rows, cols, Tp(0));
 }
 
 
 template <typename Tp=double>
-inline Array<2,Tp> ones(int rows, int cols) {
-    return std::move(Array<2,Tp>(rows, cols, Tp(1)));
+inline Array<2,Tp> ones(Index rows, Index cols) {
+    return Array<2,Tp>(rows, cols, Tp(1));
 }
 
 
 template <typename Tp=double>
-inline Array<2,Tp> identity(int rows, const Tp &factor) {
+inline Array<2,Tp> identity(Index rows, const Tp &factor) {
     Array<2,Tp> ret(rows, rows, Tp(0));
-    for (int k=0; k<rows; ++k) {
+    for (Index k=0; k<rows; ++k) {
         ret[k][k] = factor;
     }
-    return std::move(ret);
+    return ret;
 }
 
 
 template <typename Tp>
 inline Array<2,Tp> samesize(const Array<2,Tp> &other) {
-    return std::move(Array<2,Tp>(other.rows(), other.cols()));
+    return Array<2,Tp>(other.rows(), other.cols(), other.layout());
 }
 
 
 template <typename Tp=double> inline
 Array<2,Tp> row_stack(std::initializer_list<Array<1,Tp>> initList) {
-    int k = 0;
+    Index k = 0;
     for (auto &row : initList) {
         if (row.size() > k) {
             k = row.size();
@@ -635,18 +1479,18 @@ Array<2,Tp> row_stack(std::initializer_list<Array<1,Tp>> initList) {
     Array<2,Tp> ret(initList.size(), k, Tp(0));
     k = 0;
     for (auto &row : initList) {
-        for (int i=0; i<row.size(); ++i) {
+        for (Index i=0; i<row.size(); ++i) {
             ret[k][i] = row[i];
         }
         k += 1;
     }
-    return std::move(ret);
+    return ret;
 }
 
 
 template <typename Tp=double> inline
 Array<2,Tp> column_stack(std::initializer_list<Array<1,Tp>> initList) {
-    int k = 0;
+    Index k = 0;
     for (auto &column : initList) {
         if (column.size() > k) {
             k = column.size();
@@ -655,18 +1499,75 @@ Array<2,Tp> column_stack(std::initializer_list<Array<1,Tp>> initList) {
     Array<2,Tp> ret(k, initList.size(), Tp(0));
     k = 0;
     for (auto &column : initList) {
-        for (int i=0; i<column.size(); ++i) {
+        for (Index i=0; i<column.size(); ++i) {
             ret[i][k] = column[i];
         }
         k += 1;
     }
-    return std::move(ret);
+    return ret;
 }
 
 
+/*********************************************
+ * Random access iterator over the elements of
+ * a strided view. With unit stride it walks
+ * the buffer like a plain pointer
+ *********************************************/
+template <typename Tp>
+class ArrayViewIterator
+{
+public:
+
+    typedef std::random_access_iterator_tag iterator_category;
+    typedef Tp value_type;
+    typedef Index difference_type;
+    typedef const Tp* pointer;
+    typedef const Tp& reference;
+
+    ArrayViewIterator(const Tp *ptr=nullptr, Index stride=1)
+        : m_ptr(ptr), m_stride(stride)
+    { }
+
+    const Tp& operator* () const { return *m_ptr; }
+    const Tp* operator-> () const { return m_ptr; }
+    const Tp& operator[] (Index n) const { return m_ptr[n*m_stride]; }
+
+    ArrayViewIterator& operator++ () { m_ptr += m_stride; return *this; }
+    ArrayViewIterator& operator-- () { m_ptr -= m_stride; return *this; }
+    ArrayViewIterator operator++ (int) { auto ret = *this; m_ptr += m_stride; return ret; }
+    ArrayViewIterator operator-- (int) { auto ret = *this; m_ptr -= m_stride; return ret; }
+
+    ArrayViewIterator& operator+= (Index n) { m_ptr += n*m_stride; return *this; }
+    ArrayViewIterator& operator-= (Index n) { m_ptr -= n*m_stride; return *this; }
+    ArrayViewIterator operator+ (Index n) const { return ArrayViewIterator(m_ptr + n*m_stride, m_stride); }
+    ArrayViewIterator operator- (Index n) const { return ArrayViewIterator(m_ptr - n*m_stride, m_stride); }
+    Index operator- (const ArrayViewIterator &that) const { return (m_ptr - that.m_ptr)/m_stride; }
+
+    bool operator== (const ArrayViewIterator &that) const { return m_ptr == that.m_ptr; }
+    bool operator!= (const ArrayViewIterator &that) const { return m_ptr != that.m_ptr; }
+    bool operator< (const ArrayViewIterator &that) const { return m_ptr < that.m_ptr; }
+    bool operator> (const ArrayViewIterator &that) const { return m_ptr > that.m_ptr; }
+    bool operator<= (const ArrayViewIterator &that) const { return m_ptr <= that.m_ptr; }
+    bool operator>= (const ArrayViewIterator &that) const { return m_ptr >= that.m_ptr; }
+
+
+private:
+
+    const Tp *m_ptr;
+    Index m_stride;
+};
+
+
 /****************************************************
  * This array view is used by visualization tools to
- * hold a reference to the data they must show
+ * hold a reference to the data they must show.
+ * It is a read only window of "size" elements taken
+ * every "stride" positions from an offset into the
+ * storage of an array, so rows, columns and slices
+ * share the data instead of copying it. The storage
+ * is kept alive by the view, and writes to the array
+ * detach it, so the view never changes under the
+ * consumer.
  ****************************************************/
 template <typename Tp>
 class ArrayView
@@ -678,158 +1579,206 @@ public:
         ColumnView
     };
 
+    typedef Tp value_type;
+    typedef ArrayViewIterator<Tp> const_iterator;
+
 
     ArrayView();
     ArrayView(const ArrayView &that);
+    ArrayView(ArrayView &&that);
     ArrayView(const Array<1,Tp> &rowVector);
-    ArrayView(const Array<0,Tp> *storage, int type, int rowOrCol);
+    ArrayView(const Array<0,Tp> *storage, Type type, Index rowOrCol);
+    ArrayView(const Array<0,Tp> *storage, Index offset,
+              Index size, Index stride=1);
+    template <typename E> ArrayView(const ArrayExpr<E> &expr);
 
     ArrayView& operator= (const Array<1,Tp> &rowVector);
     ArrayView& operator= (const ArrayView<Tp> &that);
+    ArrayView& operator= (ArrayView<Tp> &&that);
 
     ~ArrayView();
 
-    int size() const;
+    Index size() const { return m_size; }
+    Index stride() const { return m_stride; }
+    const Tp* data() const { return m_data; }
+
+    // Elements are adjacent and data() can
+    // be used as a plain C array
+    bool isContiguous() const { return m_stride == 1; }
 
-    const Tp& operator[] (int idx) const;
+    const Tp& operator[] (Index idx) const { return m_data[idx*m_stride]; }
+
+    const_iterator begin() const { return const_iterator(m_data, m_stride); }
+    const_iterator end() const { return const_iterator(m_data + m_size*m_stride, m_stride); }
+
+    // Elements start, start+step, ... before stop, see
+    // sliceSize(). Throws std::invalid_argument if step <= 0
+    ArrayView operator() (Index start, Index stop, Index step=1) const;
+
+    const Array<0,Tp>* storage() const { return m_storage; }
 
 
 private:
 
+    void release();
+
     Array<0,Tp> *m_storage;
-    int m_type;
-    int m_rowOrCol;
+    const Tp *m_data;
+    Index m_size;
+    Index m_stride;
 };
 
 
 template <typename Tp>
-ArrayView<Tp>::ArrayView() {
-    m_storage = nullptr;
-}
+ArrayView<Tp>::ArrayView()
+    : m_storage(nullptr), m_data(nullptr)
+    , m_size(0), m_stride(1)
+{ }
 
 
 template <typename Tp>
-ArrayView<Tp>::ArrayView(const ArrayView<Tp> &that) {
+ArrayView<Tp>::ArrayView(const ArrayView<Tp> &that)
+    : m_storage(nullptr), m_data(that.m_data)
+    , m_size(that.m_size), m_stride(that.m_stride)
+{
     if (that.m_storage) {
-        m_storage = const_cast<Array<0,Tp>*>
-            (that.m_storage)->ref();
-    } else {
-        m_storage = nullptr;
+        m_storage = that.m_storage->ref();
     }
-    m_type = that.m_type;
-    m_rowOrCol = that.m_rowOrCol;
 }
 
 
 template <typename Tp>
-ArrayView<Tp>::ArrayView(const Array<1,Tp> &rowVector) {
-    if (rowVector.storage()) {
-        m_storage = const_cast<Array<0,Tp>*>
-            (rowVector.storage())->ref();
-    } else {
-        m_storage = nullptr;
-    }
-    m_type = RowView;
-    m_rowOrCol = 0;
+ArrayView<Tp>::ArrayView(ArrayView<Tp> &&that)
+    : m_storage(that.m_storage), m_data(that.m_data)
+    , m_size(that.m_size), m_stride(that.m_stride)
+{
+    that.m_storage = nullptr;
+    that.m_data = nullptr;
+    that.m_size = 0;
 }
 
 
+template <typename Tp>
+ArrayView<Tp>::ArrayView(const Array<1,Tp> &rowVector)
+    : ArrayView(rowVector.storage(), 0, rowVector.size())
+{ }
+
+
 template <typename Tp>
 ArrayView<Tp>::ArrayView(const Array<0,Tp> *storage,
-                         int type, int rowOrCol)
+                         Type type, Index rowOrCol)
+    : ArrayView()
 {
     if (storage) {
-        m_storage = const_cast<Array<0,Tp>*>
-            (storage)->ref();
-    } else {
-        m_storage = nullptr;
+        // Stride between the elements of a row and of a column
+        Index rowStep = (storage->layout() == RowMajor) ? 1 : storage->rows();
+        Index colStep = (storage->layout() == RowMajor) ? storage->cols() : 1;
+        if (type == RowView) {
+            *this = ArrayView(storage, storage->offsetOf(rowOrCol, 0),
+                              storage->cols(), rowStep);
+        } else { // type == ColumnView
+            *this = ArrayView(storage, storage->offsetOf(0, rowOrCol),
+                              storage->rows(), colStep);
+        }
     }
-    m_type = type;
-    m_rowOrCol = rowOrCol;
 }
 
 
 template <typename Tp>
-ArrayView<Tp>& ArrayView<Tp>::operator= (const Array<1,Tp> &rowVector) {
-    if (m_storage != rowVector.storage()) {
-        if (m_storage) {
-            if (const_cast<Array<0,Tp>*>
-                (m_storage)->unref())
-            {
-                delete m_storage;
-            }
-        }
-        if (rowVector.storage()) {
-            m_storage = const_cast<Array<0,Tp>*>
-                (rowVector.storage())->ref();
-        } else {
-            m_storage = nullptr;
-        }
-        m_type = RowView;
-        m_rowOrCol = 0;
+ArrayView<Tp>::ArrayView(const Array<0,Tp> *storage, Index offset,
+                         Index size, Index stride)
+    : m_storage(nullptr), m_data(nullptr)
+    , m_size(0), m_stride(stride)
+{
+    if (storage) {
+        m_storage = const_cast<Array<0,Tp>*>(storage)->ref();
+        m_data = storage->begin() + offset;
+        m_size = size;
     }
-    return *this;
+}
+
+
+template <typename Tp> template <typename E>
+ArrayView<Tp>::ArrayView(const ArrayExpr<E> &expr)
+    : ArrayView(Array<1,Tp>(expr))
+{ }
+
+
+template <typename Tp>
+ArrayView<Tp>& ArrayView<Tp>::operator= (const Array<1,Tp> &rowVector) {
+    return *this = ArrayView<Tp>(rowVector);
 }
 
 
 template <typename Tp>
 ArrayView<Tp>& ArrayView<Tp>::operator= (const ArrayView<Tp> &that) {
-    if (m_storage != that.m_storage) {
-        if (m_storage) {
-            if (const_cast<Array<0,Tp>*>
-                (m_storage)->unref())
-            {
-                delete m_storage;
-            }
-        }
+    if (this != &that) {
         if (that.m_storage) {
-            m_storage = const_cast<Array<0,Tp>*>
-                (that.m_storage)->ref();
-        } else {
-            m_storage = nullptr;
+            that.m_storage->ref();
         }
-        m_type = that.m_type;
-        m_rowOrCol = that.m_rowOrCol;
+        release();
+        m_storage = that.m_storage;
+        m_data = that.m_data;
+        m_size = that.m_size;
+        m_stride = that.m_stride;
     }
     return *this;
 }
 
 
 template <typename Tp>
-ArrayView<Tp>::~ArrayView() {
-    if (m_storage) {
-        if (const_cast<Array<0,Tp>*>
-            (m_storage)->unref())
-        {
-            delete m_storage;
-        }
+ArrayView<Tp>& ArrayView<Tp>::operator= (ArrayView<Tp> &&that) {
+    if (this != &that) {
+        release();
+        m_storage = that.m_storage;
+        m_data = that.m_data;
+        m_size = that.m_size;
+        m_stride = that.m_stride;
+        that.m_storage = nullptr;
+        that.m_data = nullptr;
+        that.m_size = 0;
     }
+    return *this;
+}
+
+
+template <typename Tp>
+ArrayView<Tp>::~ArrayView() {
+    release();
 }
 
 
 template <typename Tp>
-int ArrayView<Tp>::size() const {
-    if (!m_storage) {
-        return 0;
+void ArrayView<Tp>::release() {
+    if (m_storage && m_storage->unref()) {
+        delete m_storage;
     }
-    if (m_type == RowView) {
-        return m_storage->cols();
-    } // else: m_type == ColumnView
-    return m_storage->rows();
+    m_storage = nullptr;
+}
+
+
+template <typename Tp>
+ArrayView<Tp> ArrayView<Tp>::operator() (Index start, Index stop,
+                                         Index step) const
+{
+    ArrayView<Tp> ret(*this);
+    ret.m_size = sliceSize(m_size, start, stop, step);
+    ret.m_data = m_data + start*m_stride;
+    ret.m_stride = m_stride*step;
+    return ret;
 }
 
 
 template <typename Tp>
-const Tp& ArrayView<Tp>::operator[] (int idx) const {
-    if (m_type == RowView) {
-        return m_storage->valueAt(m_rowOrCol*m_storage->cols() + idx);
-    } // else: m_type == ColumnView
-    return m_storage->valueAt(m_rowOrCol + idx*m_storage->cols());
+ArrayView<Tp> Array<1,Tp>::operator() (Index start, Index stop,
+                                       Index step) const
+{
+    return ArrayView<Tp>(*this)(start, stop, step);
 }
 
 
 template <typename Tp> inline
-ArrayView<Tp> row(const Array<2,Tp> &matrix, int idx) {
+ArrayView<Tp> row(const Array<2,Tp> &matrix, Index idx) {
     return ArrayView<Tp>(
         matrix.storage(),
         ArrayView<Tp>::RowView,
@@ -838,7 +1787,7 @@ ArrayView<Tp> row(const Array<2,Tp> &matrix, int idx) {
 
 
 template <typename Tp> inline
-ArrayView<Tp> col(const Array<2,Tp> &matrix, int idx) {
+ArrayView<Tp> col(const Array<2,Tp> &matrix, Index idx) {
     return ArrayView<Tp>(
         matrix.storage(),
         ArrayView<Tp>::ColumnView,
@@ -846,6 +1795,116 @@ ArrayView<Tp> col(const Array<2,Tp> &matrix, int idx) {
 }
 
 
+/****************************************************
+ * Read only rectangular window of a matrix. Element
+ * (i,j) of the block is at i*rowStride + j*colStride
+ * from data(), in the storage it shares with the
+ * matrix. One of the strides is 1, depending on the
+ * layout of the matrix.
+ ****************************************************/
+template <typename Tp>
+class ArrayBlock
+{
+public:
+
+    typedef Tp value_type;
+
+
+    ArrayBlock()
+        : m_rows(0), m_cols(0), m_rowStride(0), m_colStride(0)
+    { }
+
+    ArrayBlock(const Array<2,Tp> &matrix)
+        : ArrayBlock(matrix, 0, 0, matrix.rows(), matrix.cols())
+    { }
+
+    // Rows i to i+rows and columns j to j+cols, clamped
+    // to the matrix like the slices, see sliceSize()
+    ArrayBlock(const Array<2,Tp> &matrix, Index i, Index j,
+               Index rows, Index cols)
+        : m_rows(sliceSize(matrix.rows(), i, i + rows, 1))
+        , m_cols(sliceSize(matrix.cols(), j, j + cols, 1))
+    {
+        bool rowMajor = (matrix.layout() == RowMajor);
+        m_rowStride = rowMajor ? matrix.cols() : 1;
+        m_colStride = rowMajor ? 1 : matrix.rows();
+        if (matrix.storage() && m_rows > 0 && m_cols > 0) {
+            // The view spans from the first to the last element
+            m_data = ArrayView<Tp>(matrix.storage(),
+                matrix.storage()->offsetOf(i, j),
+                (m_rows-1)*m_rowStride + (m_cols-1)*m_colStride + 1);
+        }
+    }
+
+    Index rows() const { return m_rows; }
+    Index cols() const { return m_cols; }
+    Index size() const { return m_rows*m_cols; }
+    Index rowStride() const { return m_rowStride; }
+    Index colStride() const { return m_colStride; }
+    ArrayLayout layout() const { return m_colStride == 1 ? RowMajor : ColumnMajor; }
+    const Tp* data() const { return m_data.data(); }
+
+    // The elements are adjacent and data() can be used
+    // as a C array in the layout of the matrix
+    bool isContiguous() const {
+        return (m_colStride == 1 && m_rowStride == m_cols) ||
+               (m_rowStride == 1 && m_colStride == m_rows);
+    }
+
+    const Tp& operator() (Index i, Index j) const {
+        return data()[i*m_rowStride + j*m_colStride];
+    }
+
+    // Empty views for empty blocks
+    ArrayView<Tp> row(Index i) const {
+        if (!m_data.storage()) {
+            return ArrayView<Tp>();
+        }
+        return ArrayView<Tp>(m_data.storage(),
+            offset() + i*m_rowStride, m_cols, m_colStride);
+    }
+
+    ArrayView<Tp> col(Index j) const {
+        if (!m_data.storage()) {
+            return ArrayView<Tp>();
+        }
+        return ArrayView<Tp>(m_data.storage(),
+            offset() + j*m_colStride, m_rows, m_rowStride);
+    }
+
+
+private:
+
+    Index offset() const { return data() - m_data.storage()->begin(); }
+
+    ArrayView<Tp> m_data;
+    Index m_rows;
+    Index m_cols;
+    Index m_rowStride;
+    Index m_colStride;
+};
+
+
+template <typename Tp> inline
+ArrayBlock<Tp> block(const Array<2,Tp> &matrix, Index i, Index j,
+                     Index rows, Index cols)
+{
+    return ArrayBlock<Tp>(matrix, i, j, rows, cols);
+}
+
+
+template <typename Tp> inline
+ArrayView<Tp> row(const ArrayBlock<Tp> &block, Index idx) {
+    return block.row(idx);
+}
+
+
+template <typename Tp> inline
+ArrayView<Tp> col(const ArrayBlock<Tp> &block, Index idx) {
+    return block.col(idx);
+}
+
+
 /*********************************************
  * Functions that can be applyed to arrays
  * of any dimension
@@ -855,10 +1914,72 @@ ArrayView<Tp> col(const Array<2,Tp> &matrix, int idx) {
 template <int D, typename Tp>
 inline Array<D,Tp> copy(const Array<D,Tp> &other) {
     auto ret = samesize(other);
-    for (int k=0; k<ret.size(); ++k) {
-        ret.at(k) = other.at(k);
+    std::copy(other.begin(), other.end(), ret.begin());
+    return ret;
+}
+
+
+template <typename Tp>
+inline Array<1,Tp> copy(const ArrayView<Tp> &view) {
+    Array<1,Tp> ret(view.size());
+    std::copy(view.begin(), view.end(), ret.begin());
+    return ret;
+}
+
+
+// The copy is row major, whatever the layout of the block
+template <typename Tp>
+inline Array<2,Tp> copy(const ArrayBlock<Tp> &block) {
+    Array<2,Tp> ret(block.rows(), block.cols());
+    if (ret.size() == 0) {
+        return ret;
+    }
+    if (block.colStride() == 1) {
+        for (Index i=0; i<block.rows(); ++i) {
+            const Tp *row = block.data() + i*block.rowStride();
+            std::copy(row, row + block.cols(), ret[i]);
+        }
+    } else {
+        transposeKernel(block.data(), block.colStride(), ret.begin(),
+                        block.cols(), block.cols(), block.rows());
+    }
+    return ret;
+}
+
+
+/*********************************************
+ * Transposes and layout conversions of
+ * matrices, using the cache oblivious kernel
+ *********************************************/
+
+
+// The transposed matrix, in the layout of the original
+template <typename Tp>
+inline Array<2,Tp> transpose(const Array<2,Tp> &matrix) {
+    Array<2,Tp> ret(matrix.cols(), matrix.rows(), matrix.layout());
+    if (ret.size() == 0) {
+        return ret;
+    }
+    // Lines are rows or columns, as the layout says
+    Index lines = (matrix.layout() == RowMajor) ? matrix.rows() : matrix.cols();
+    Index length = matrix.size() / lines;
+    transposeKernel(matrix.begin(), length, ret.begin(), lines, lines, length);
+    return ret;
+}
+
+
+// The same matrix stored in the given layout. No copy is
+// made if it already has that layout
+template <typename Tp>
+inline Array<2,Tp> toLayout(const Array<2,Tp> &matrix, ArrayLayout layout) {
+    if (matrix.layout() == layout || matrix.size() == 0) {
+        return matrix;
     }
-    return std::move(ret);
+    Array<2,Tp> ret(matrix.rows(), matrix.cols(), layout);
+    Index lines = (matrix.layout() == RowMajor) ? matrix.rows() : matrix.cols();
+    Index length = matrix.size() / lines;
+    transposeKernel(matrix.begin(), length, ret.begin(), lines, lines, length);
+    return ret;
 }
 
 
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2016  Elvis Teixeira
+ *
+ * This source code is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General
+ * Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This source code is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <Ksl/ArrayAllocator.h>
+#include <Ksl/MemoryPool.h>
+
+#ifdef Q_OS_LINUX
+#include <sys/mman.h>
+#endif // Q_OS_LINUX
+
+namespace Ksl {
+
+HugePageAllocator::HugePageAllocator(std::size_t threshold)
+    : m_threshold(threshold)
+{ }
+
+
+void* HugePageAllocator::allocate(std::size_t bytes) {
+#ifdef Q_OS_LINUX
+    if (bytes >= m_threshold) {
+        void *ptr = mmap(nullptr, bytes, PROT_READ|PROT_WRITE,
+                         MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+        if (ptr == MAP_FAILED)
+            return nullptr;
+#ifdef MADV_HUGEPAGE
+        madvise(ptr, bytes, MADV_HUGEPAGE);
+#endif // MADV_HUGEPAGE
+        return ptr;
+    }
+#endif // Q_OS_LINUX
+    return heap().allocate(bytes);
+}
+
+
+void HugePageAllocator::deallocate(void *ptr, std::size_t bytes) {
+    if (!ptr)
+        return;
+#ifdef Q_OS_LINUX
+    if (bytes >= m_threshold) {
+        munmap(ptr, bytes);
+        return;
+    }
+#endif // Q_OS_LINUX
+    heap().deallocate(ptr, bytes);
+}
+
+
+void* PoolAllocator::allocate(std::size_t bytes) {
+    return m_pool->allocBytes(bytes, KSL_ARRAY_ALIGNMENT);
+}
+
+
+void PoolAllocator::deallocate(void *ptr, std::size_t bytes) {
+    m_pool->freeBytes(ptr, bytes, KSL_ARRAY_ALIGNMENT);
+}
+
+
+void* PoolAllocator::allocateStorage(std::size_t bytes) {
+    void *ptr = m_pool->allocBytes(bytes);
+    if (!ptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+
+void PoolAllocator::deallocateStorage(void *ptr, std::size_t bytes) {
+    m_pool->freeBytes(ptr, bytes);
+}
+
+} // namespace Ksl
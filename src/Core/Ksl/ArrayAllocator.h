@@ -0,0 +1,257 @@
+/*
+ * Copyright (C) 2016  Elvis Teixeira
+ *
+ * This source code is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General
+ * Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This source code is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef KSL_ARRAYALLOCATOR_H
+#define KSL_ARRAYALLOCATOR_H
+
+#include <Ksl/Global.h>
+#include <QtGlobal>
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <functional>
+
+// Alignment, in bytes, of the array buffers. Enough
+// for the widest vector loads and a full cache line
+#ifndef KSL_ARRAY_ALIGNMENT
+#define KSL_ARRAY_ALIGNMENT 64
+#endif
+
+namespace Ksl {
+
+// Forward declaration
+class MemoryPool;
+
+
+/*********************************************
+ * Source of the buffers of Array<0,Tp>. Each
+ * storage block remembers the allocator that
+ * created it, so the allocator must outlive
+ * all the arrays using it.
+ *********************************************/
+class KSL_EXPORT ArrayAllocator
+{
+public:
+
+    virtual ~ArrayAllocator() { }
+
+    virtual void* allocate(std::size_t bytes) = 0;
+
+    virtual void deallocate(void *ptr, std::size_t bytes) = 0;
+
+    // The default moves the contents to a new block. On
+    // failure it returns nullptr and keeps the old block
+    virtual void* reallocate(void *ptr, std::size_t oldBytes,
+                             std::size_t newBytes)
+    {
+        void *ret = allocate(newBytes);
+        if (ret && ptr) {
+            std::memcpy(ret, ptr, oldBytes < newBytes ? oldBytes : newBytes);
+            deallocate(ptr, oldBytes);
+        }
+        return ret;
+    }
+
+    // Source of the Array<0,Tp> blocks themselves,
+    // the heap unless the allocator has a better one
+    virtual void* allocateStorage(std::size_t bytes) {
+        return ::operator new(bytes);
+    }
+
+    virtual void deallocateStorage(void *ptr, std::size_t bytes) {
+        Q_UNUSED(bytes)
+        ::operator delete(ptr);
+    }
+
+
+    // Aligned heap allocator used when no other is given
+    static ArrayAllocator& heap();
+
+    // Allocator used by new arrays created in this thread
+    static ArrayAllocator& current();
+
+    // Changes the allocator used by new arrays in this
+    // thread and returns the previous one. Passing
+    // nullptr restores the heap allocator
+    static ArrayAllocator* setCurrent(ArrayAllocator *allocator);
+
+
+private:
+
+    static ArrayAllocator*& currentSlot() {
+        static thread_local ArrayAllocator *slot = nullptr;
+        return slot;
+    }
+};
+
+
+/*********************************************
+ * Owner of a buffer that the array did not
+ * allocate, like a file mapping. The storage
+ * deletes it, releasing the buffer, when the
+ * last array using the buffer goes away or
+ * when the array outgrows it.
+ *********************************************/
+class KSL_EXPORT ArrayBufferOwner
+{
+public:
+
+    virtual ~ArrayBufferOwner() { }
+};
+
+
+/*********************************************
+ * Owner that runs a callback to release the
+ * buffer, like freeing a DMA buffer or
+ * dropping the QByteArray that a lambda
+ * captured by value. An empty callback only
+ * borrows the buffer, which must then outlive
+ * the arrays.
+ *********************************************/
+class KSL_EXPORT ArrayBufferReleaser
+    : public ArrayBufferOwner
+{
+public:
+
+    ArrayBufferReleaser(const std::function<void()> &release)
+        : m_release(release)
+    { }
+
+    ~ArrayBufferReleaser() {
+        if (m_release) {
+            m_release();
+        }
+    }
+
+
+private:
+
+    std::function<void()> m_release;
+};
+
+
+/*********************************************
+ * Heap allocator returning aligned buffers
+ *********************************************/
+class KSL_EXPORT AlignedAllocator
+    : public ArrayAllocator
+{
+public:
+
+    AlignedAllocator(std::size_t alignment=KSL_ARRAY_ALIGNMENT)
+        : m_alignment(alignment)
+    { }
+
+    void* allocate(std::size_t bytes) {
+        return qMallocAligned(bytes, m_alignment);
+    }
+
+    void deallocate(void *ptr, std::size_t bytes) {
+        Q_UNUSED(bytes)
+        qFreeAligned(ptr);
+    }
+
+    void* reallocate(void *ptr, std::size_t oldBytes, std::size_t newBytes) {
+        return qReallocAligned(ptr, newBytes, oldBytes, m_alignment);
+    }
+
+
+private:
+
+    std::size_t m_alignment;
+};
+
+
+/*********************************************
+ * Backs big arrays with transparent huge pages,
+ * where the system supports them, to reduce
+ * TLB misses. Small arrays use the heap
+ *********************************************/
+class KSL_EXPORT HugePageAllocator
+    : public ArrayAllocator
+{
+public:
+
+    HugePageAllocator(std::size_t threshold=std::size_t(2)<<20);
+
+    void* allocate(std::size_t bytes);
+
+    void deallocate(void *ptr, std::size_t bytes);
+
+
+private:
+
+    std::size_t m_threshold;
+};
+
+
+/*********************************************
+ * Takes array buffers and storage blocks from
+ * a MemoryPool, for fast temporaries. Freed
+ * buffers are reused by the pool, memory goes
+ * back to the system when the pool is destroyed
+ *********************************************/
+class KSL_EXPORT PoolAllocator
+    : public ArrayAllocator
+{
+public:
+
+    PoolAllocator(MemoryPool *pool)
+        : m_pool(pool)
+    { }
+
+    MemoryPool* pool() const { return m_pool; }
+
+    void* allocate(std::size_t bytes);
+
+    void deallocate(void *ptr, std::size_t bytes);
+
+    void* allocateStorage(std::size_t bytes);
+
+    void deallocateStorage(void *ptr, std::size_t bytes);
+
+
+private:
+
+    MemoryPool *m_pool;
+};
+
+
+inline ArrayAllocator& ArrayAllocator::heap() {
+    static AlignedAllocator allocator;
+    return allocator;
+}
+
+
+inline ArrayAllocator& ArrayAllocator::current() {
+    ArrayAllocator *allocator = currentSlot();
+    return allocator ? *allocator : heap();
+}
+
+
+inline ArrayAllocator* ArrayAllocator::setCurrent(ArrayAllocator *allocator) {
+    ArrayAllocator *previous = &current();
+    currentSlot() = allocator;
+    return previous;
+}
+
+} // namespace Ksl
+
+#endif // KSL_ARRAYALLOCATOR_H
@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2016  Elvis Teixeira
+ *
+ * This source code is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General
+ * Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This source code is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef KSL_ARRAYAPPLY_H
+#define KSL_ARRAYAPPLY_H
+
+#include <Ksl/Array.h>
+#include <Ksl/ThreadPool.h>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+namespace Ksl {
+
+// Type returned by func for arguments of type Args
+template <typename F, typename... Args>
+struct ArrayApplyResult {
+    typedef typename std::decay<
+        decltype(std::declval<F&>()(std::declval<Args>()...))>::type type;
+};
+
+
+// Calls func(k) for every k in [0,size), in
+// ranges run by the threads of the global pool
+template <typename F> inline
+void parallelIndexes(Index size, Index grain, F func) {
+    ThreadPool::global().parallelFor(size, grain, [&func](Index begin, Index end) {
+        for (Index k=begin; k<end; ++k) {
+            func(k);
+        }
+    });
+}
+
+
+/*********************************************
+ * Element-wise functions run in parallel on
+ * ThreadPool::global(), e.g.
+ *   auto y = apply(Math::sin, x);
+ *   auto I = zip_transform(intensity, qx, qy);
+ *   auto m = generate([](Index i, Index j) {
+ *       return double(i == j); }, 10, 10);
+ * func is called from many threads at once and
+ * must not modify shared state. grain is the
+ * smallest number of elements given to a
+ * thread, lower it for expensive functions.
+ *********************************************/
+
+template <typename F, typename Tp> inline
+Array<1,typename ArrayApplyResult<F,const Tp&>::type>
+apply(F func, const Array<1,Tp> &array, Index grain=KSL_PARALLEL_GRAIN) {
+    typedef typename ArrayApplyResult<F,const Tp&>::type R;
+    Array<1,R> ret(array.size());
+    const Tp *src = array.begin();
+    R *dest = ret.begin();
+    parallelIndexes(array.size(), grain, [&](Index k) {
+        dest[k] = func(src[k]);
+    });
+    return ret;
+}
+
+
+template <typename F, typename Tp> inline
+Array<2,typename ArrayApplyResult<F,const Tp&>::type>
+apply(F func, const Array<2,Tp> &array, Index grain=KSL_PARALLEL_GRAIN) {
+    typedef typename ArrayApplyResult<F,const Tp&>::type R;
+    Array<2,R> ret(array.rows(), array.cols(), array.layout());
+    const Tp *src = array.begin();
+    R *dest = ret.begin();
+    parallelIndexes(array.size(), grain, [&](Index k) {
+        dest[k] = func(src[k]);
+    });
+    return ret;
+}
+
+
+template <typename F, typename Tp> inline
+Array<1,typename ArrayApplyResult<F,const Tp&>::type>
+apply(F func, const ArrayView<Tp> &view, Index grain=KSL_PARALLEL_GRAIN) {
+    typedef typename ArrayApplyResult<F,const Tp&>::type R;
+    Array<1,R> ret(view.size());
+    R *dest = ret.begin();
+    parallelIndexes(view.size(), grain, [&](Index k) {
+        dest[k] = func(view[k]);
+    });
+    return ret;
+}
+
+
+// The result of a block is a row major matrix
+template <typename F, typename Tp> inline
+Array<2,typename ArrayApplyResult<F,const Tp&>::type>
+apply(F func, const ArrayBlock<Tp> &block, Index grain=KSL_PARALLEL_GRAIN) {
+    typedef typename ArrayApplyResult<F,const Tp&>::type R;
+    Array<2,R> ret(block.rows(), block.cols());
+    Index cols = block.cols();
+    R *dest = ret.begin();
+    parallelIndexes(block.rows(), grain/std::max(cols, Index(1)), [&](Index i) {
+        for (Index j=0; j<cols; ++j) {
+            dest[i*cols + j] = func(block(i, j));
+        }
+    });
+    return ret;
+}
+
+
+// Replaces each element by func(element)
+template <typename F, int D, typename Tp> inline
+void transform(F func, Array<D,Tp> &array, Index grain=KSL_PARALLEL_GRAIN) {
+    Tp *data = array.begin();
+    parallelIndexes(array.size(), grain, [&](Index k) {
+        data[k] = func(data[k]);
+    });
+}
+
+
+template <typename F, typename T1, typename T2> inline
+Array<1,typename ArrayApplyResult<F,const T1&,const T2&>::type>
+zip_transform(F func, const ArrayView<T1> &a, const ArrayView<T2> &b,
+              Index grain=KSL_PARALLEL_GRAIN)
+{
+    typedef typename ArrayApplyResult<F,const T1&,const T2&>::type R;
+    if (a.size() != b.size()) {
+        throw std::invalid_argument("Ksl::zip_transform: sizes differ");
+    }
+    Array<1,R> ret(a.size());
+    R *dest = ret.begin();
+    parallelIndexes(a.size(), grain, [&](Index k) {
+        dest[k] = func(a[k], b[k]);
+    });
+    return ret;
+}
+
+
+template <typename F, typename T1, typename T2> inline
+Array<1,typename ArrayApplyResult<F,const T1&,const T2&>::type>
+zip_transform(F func, const Array<1,T1> &a, const Array<1,T2> &b,
+              Index grain=KSL_PARALLEL_GRAIN)
+{
+    return zip_transform(func, ArrayView<T1>(a), ArrayView<T2>(b), grain);
+}
+
+
+// b is converted to the layout of a if they differ
+template <typename F, typename T1, typename T2> inline
+Array<2,typename ArrayApplyResult<F,const T1&,const T2&>::type>
+zip_transform(F func, const Array<2,T1> &a, const Array<2,T2> &b,
+              Index grain=KSL_PARALLEL_GRAIN)
+{
+    typedef typename ArrayApplyResult<F,const T1&,const T2&>::type R;
+    if (a.rows() != b.rows() || a.cols() != b.cols()) {
+        throw std::invalid_argument("Ksl::zip_transform: shapes differ");
+    }
+    Array<2,T2> other = toLayout(b, a.layout());
+    Array<2,R> ret(a.rows(), a.cols(), a.layout());
+    const T1 *src1 = a.begin();
+    const T2 *src2 = static_cast<const Array<2,T2>&>(other).begin();
+    R *dest = ret.begin();
+    parallelIndexes(a.size(), grain, [&](Index k) {
+        dest[k] = func(src1[k], src2[k]);
+    });
+    return ret;
+}
+
+
+// Array of func(k) for k in [0,size)
+template <typename F> inline
+Array<1,typename ArrayApplyResult<F,Index>::type>
+generate(F func, Index size, Index grain=KSL_PARALLEL_GRAIN) {
+    typedef typename ArrayApplyResult<F,Index>::type R;
+    Array<1,R> ret(size);
+    R *dest = ret.begin();
+    parallelIndexes(size, grain, [&](Index k) {
+        dest[k] = func(k);
+    });
+    return ret;
+}
+
+
+// Matrix of func(i,j)
+template <typename F> inline
+Array<2,typename ArrayApplyResult<F,Index,Index>::type>
+generate(F func, Index rows, Index cols, ArrayLayout layout=RowMajor,
+         Index grain=KSL_PARALLEL_GRAIN)
+{
+    typedef typename ArrayApplyResult<F,Index,Index>::type R;
+    Array<2,R> ret(rows, cols, layout);
+    R *dest = ret.begin();
+    Index lines = (layout == RowMajor) ? rows : cols;
+    Index length = (layout == RowMajor) ? cols : rows;
+    parallelIndexes(lines, grain/std::max(length, Index(1)), [&](Index l) {
+        R *line = dest + l*length;
+        for (Index k=0; k<length; ++k) {
+            line[k] = (layout == RowMajor) ? func(l, k) : func(k, l);
+        }
+    });
+    return ret;
+}
+
+} // namespace Ksl
+
+#endif // KSL_ARRAYAPPLY_H
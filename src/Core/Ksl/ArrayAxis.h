@@ -0,0 +1,354 @@
+/*
+ * Copyright (C) 2016  Elvis Teixeira
+ *
+ * This source code is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General
+ * Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This source code is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef KSL_ARRAYAXIS_H
+#define KSL_ARRAYAXIS_H
+
+#include <Ksl/ArrayReduce.h>
+#include <Ksl/ArrayApply.h>
+#include <vector>
+
+// Elements reduced by a thread before it merges
+// its partial results, fixed so the results do
+// not depend on the number of threads
+#ifndef KSL_AXIS_BLOCK
+#define KSL_AXIS_BLOCK 65536
+#endif
+
+namespace Ksl {
+
+// Direction of the reductions of a matrix, the values
+// are numpy's axis argument: PerColumn collapses the
+// rows into one value per column, PerRow the columns
+enum ArrayAxis {
+    PerColumn = 0,
+    PerRow = 1
+};
+
+
+/*********************************************
+ * A matrix seen as it lies in memory: lines
+ * (rows or columns, after the layout) of
+ * contiguous elements. A reduction across the
+ * lines accumulates all the results at once,
+ * element by element of each line, one along
+ * the lines reduces each line on its own.
+ *********************************************/
+template <typename Tp>
+struct ArrayLines
+{
+    ArrayLines(const Array<2,Tp> &matrix, ArrayAxis axis)
+        : data(matrix.begin())
+    {
+        bool rowMajor = (matrix.layout() == RowMajor);
+        lines = rowMajor ? matrix.rows() : matrix.cols();
+        length = rowMajor ? matrix.cols() : matrix.rows();
+        across = ((axis == PerColumn) == rowMajor);
+    }
+
+    const Tp* line(Index l) const { return data + l*length; }
+
+    // Size of the result
+    Index results() const { return across ? length : lines; }
+
+    // Elements reduced into each result
+    Index count() const { return across ? lines : length; }
+
+    // Folds the lines in blocks run in parallel. Each block
+    // starts its state with init(state, first line) and adds
+    // the others with fold(state, line). The partial states
+    // are returned in the order of the blocks
+    template <typename State, typename Init, typename Fold>
+    std::vector<State> foldBlocks(Init init, Fold fold) const {
+        Index block = std::max(Index(1), Index(KSL_AXIS_BLOCK)/std::max(length, Index(1)));
+        std::vector<State> partial((lines + block - 1)/block);
+        parallelIndexes(Index(partial.size()), 1, [&](Index b) {
+            Index l0 = b*block;
+            Index l1 = std::min(l0 + block, lines);
+            init(partial[b], line(l0));
+            for (Index l=l0+1; l<l1; ++l) {
+                fold(partial[b], line(l));
+            }
+        });
+        return partial;
+    }
+
+    // Calls func(l, line) for every line, in parallel
+    template <typename F>
+    void forLines(F func) const {
+        parallelIndexes(lines, KSL_PARALLEL_GRAIN/std::max(length, Index(1)),
+                        [&](Index l) { func(l, line(l)); });
+    }
+
+    const Tp *data;
+    Index lines;
+    Index length;
+    bool across;
+};
+
+
+// Reduction with an associative op(a,b), lineOp(line,
+// length) reduces a contiguous line, it may be a SIMD
+// kernel doing the same as op
+template <typename Tp, typename Op, typename LineOp>
+Array<1,Tp> axisReduce(const Array<2,Tp> &matrix, ArrayAxis axis,
+                       Op op, LineOp lineOp)
+{
+    if (matrix.size() == 0) {
+        return Array<1,Tp>();
+    }
+    ArrayLines<Tp> m(matrix, axis);
+    Array<1,Tp> ret(m.results());
+    Tp *dest = ret.begin();
+    if (m.across) {
+        Index length = m.length;
+        auto partial = m.template foldBlocks<std::vector<Tp>>(
+            [length](std::vector<Tp> &acc, const Tp *line) {
+                acc.assign(line, line + length);
+            },
+            [length,op](std::vector<Tp> &acc, const Tp *line) {
+                Tp *a = acc.data();
+                for (Index j=0; j<length; ++j) {
+                    a[j] = op(a[j], line[j]);
+                }
+            });
+        std::copy(partial[0].begin(), partial[0].end(), dest);
+        for (size_t b=1; b<partial.size(); ++b) {
+            for (Index j=0; j<length; ++j) {
+                dest[j] = op(dest[j], partial[b][j]);
+            }
+        }
+    } else {
+        Index length = m.length;
+        m.forLines([&](Index l, const Tp *line) {
+            dest[l] = lineOp(line, length);
+        });
+    }
+    return ret;
+}
+
+
+/*********************************************
+ * Reductions of a matrix along one axis, in a
+ * single pass over memory, e.g. the column
+ * means of a data set:
+ *   auto mu = mean(X, PerColumn);
+ *********************************************/
+
+template <typename Tp, typename Op> inline
+Array<1,Tp> reduce(const Array<2,Tp> &matrix, ArrayAxis axis, Op op) {
+    return axisReduce(matrix, axis, op, [op](const Tp *line, Index length) {
+        Tp acc = line[0];
+        for (Index k=1; k<length; ++k) {
+            acc = op(acc, line[k]);
+        }
+        return acc;
+    });
+}
+
+
+template <typename Tp> inline
+Array<1,Tp> sum(const Array<2,Tp> &matrix, ArrayAxis axis) {
+    return axisReduce(matrix, axis,
+        [](const Tp &a, const Tp &b) { return a + b; },
+        [](const Tp *line, Index length) { return sum(line, length); });
+}
+
+
+template <typename Tp> inline
+Array<1,Tp> min(const Array<2,Tp> &matrix, ArrayAxis axis) {
+    return axisReduce(matrix, axis,
+        [](const Tp &a, const Tp &b) { return b < a ? b : a; },
+        [](const Tp *line, Index length) {
+            Tp min, max;
+            minmax(line, length, 1, min, max);
+            return min;
+        });
+}
+
+
+template <typename Tp> inline
+Array<1,Tp> max(const Array<2,Tp> &matrix, ArrayAxis axis) {
+    return axisReduce(matrix, axis,
+        [](const Tp &a, const Tp &b) { return a < b ? b : a; },
+        [](const Tp *line, Index length) {
+            Tp min, max;
+            minmax(line, length, 1, min, max);
+            return max;
+        });
+}
+
+
+template <typename Tp> inline
+Array<1,double> mean(const Array<2,Tp> &matrix, ArrayAxis axis) {
+    Array<1,double> ret;
+    if (matrix.size() == 0) {
+        return ret;
+    }
+    const Array<1,Tp> s = sum(matrix, axis);
+    ret = Array<1,double>(s.size());
+    double count = double(ArrayLines<Tp>(matrix, axis).count());
+    const Tp *src = s.begin();
+    double *dest = ret.begin();
+    for (Index k=0; k<s.size(); ++k) {
+        dest[k] = double(src[k])/count;
+    }
+    return ret;
+}
+
+
+// Mean and variance, with count - ddof degrees of
+// freedom, in one pass. Blocks sum the deviations
+// from their first line, which keeps the precision
+// of two passes, and are merged with Chan's formula
+template <typename Tp>
+void meanVar(const Array<2,Tp> &matrix, ArrayAxis axis,
+             Array<1,double> &mean, Array<1,double> &var, int ddof=0)
+{
+    if (matrix.size() == 0) {
+        mean = var = Array<1,double>();
+        return;
+    }
+    ArrayLines<Tp> m(matrix, axis);
+    mean = Array<1,double>(m.results());
+    var = Array<1,double>(m.results());
+    double *mu = mean.begin();
+    double *v = var.begin();
+    Index length = m.length;
+
+    if (m.across) {
+        struct State {
+            std::vector<double> shift, s1, s2;
+            Index n;
+        };
+        auto partial = m.template foldBlocks<State>(
+            [length](State &s, const Tp *line) {
+                s.shift.assign(line, line + length);
+                s.s1.assign(length, 0.0);
+                s.s2.assign(length, 0.0);
+                s.n = 1;
+            },
+            [length](State &s, const Tp *line) {
+                const double *shift = s.shift.data();
+                double *s1 = s.s1.data();
+                double *s2 = s.s2.data();
+                for (Index j=0; j<length; ++j) {
+                    double d = double(line[j]) - shift[j];
+                    s1[j] += d;
+                    s2[j] += d*d;
+                }
+                s.n += 1;
+            });
+        // v holds the sums of squared deviations until the end
+        double n = 0.0;
+        for (auto &s : partial) {
+            double nb = double(s.n);
+            for (Index j=0; j<length; ++j) {
+                double mb = s.shift[j] + s.s1[j]/nb;
+                double m2b = s.s2[j] - s.s1[j]*s.s1[j]/nb;
+                if (n == 0.0) {
+                    mu[j] = mb;
+                    v[j] = m2b;
+                } else {
+                    double delta = mb - mu[j];
+                    mu[j] += delta*nb/(n + nb);
+                    v[j] += m2b + delta*delta*n*nb/(n + nb);
+                }
+            }
+            n += nb;
+        }
+    } else {
+        // Each line is read from memory once, the second
+        // pass over it finds it in cache
+        m.forLines([&](Index l, const Tp *line) {
+            double shift = double(line[0]);
+            double s = 0.0;
+            for (Index k=1; k<length; ++k) {
+                s += double(line[k]) - shift;
+            }
+            double lineMean = shift + s/double(length);
+            double m2 = 0.0;
+            for (Index k=0; k<length; ++k) {
+                double d = double(line[k]) - lineMean;
+                m2 += d*d;
+            }
+            mu[l] = lineMean;
+            v[l] = m2;
+        });
+    }
+
+    double dof = double(m.count() - ddof);
+    for (Index k=0; k<var.size(); ++k) {
+        v[k] = dof > 0.0 ? v[k]/dof : std::numeric_limits<double>::quiet_NaN();
+    }
+}
+
+
+template <typename Tp> inline
+Array<1,double> var(const Array<2,Tp> &matrix, ArrayAxis axis, int ddof=0) {
+    Array<1,double> mean, var;
+    meanVar(matrix, axis, mean, var, ddof);
+    return var;
+}
+
+
+// (x - mean)/std along the axis, e.g. the features
+// in the columns of a regression input. Constant
+// lines are only centered
+template <typename Tp> inline
+Array<2,double> standardize(const Array<2,Tp> &matrix, ArrayAxis axis=PerColumn,
+                            int ddof=0)
+{
+    Array<1,double> mean, var;
+    meanVar(matrix, axis, mean, var, ddof);
+    Array<2,double> ret(matrix.rows(), matrix.cols(), matrix.layout());
+    if (matrix.size() == 0) {
+        return ret;
+    }
+    Array<1,double> scale(var.size());
+    const double *v = static_cast<const Array<1,double>&>(var).begin();
+    double *sc = scale.begin();
+    for (Index k=0; k<var.size(); ++k) {
+        sc[k] = v[k] > 0.0 ? 1.0/std::sqrt(v[k]) : 1.0;
+    }
+
+    ArrayLines<Tp> m(matrix, axis);
+    double *dest = ret.begin();
+    const double *mu = static_cast<const Array<1,double>&>(mean).begin();
+    const double *s = static_cast<const Array<1,double>&>(scale).begin();
+    Index length = m.length;
+    m.forLines([&](Index l, const Tp *line) {
+        double *out = dest + l*length;
+        if (m.across) {
+            for (Index j=0; j<length; ++j) {
+                out[j] = (double(line[j]) - mu[j])*s[j];
+            }
+        } else {
+            for (Index k=0; k<length; ++k) {
+                out[k] = (double(line[k]) - mu[l])*s[l];
+            }
+        }
+    });
+    return ret;
+}
+
+} // namespace Ksl
+
+#endif // KSL_ARRAYAXIS_H
@@ -0,0 +1,475 @@
+/*
+ * Copyright (C) 2016  Elvis Teixeira
+ *
+ * This source code is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General
+ * Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This source code is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef KSL_ARRAYEXPR_H
+#define KSL_ARRAYEXPR_H
+
+#include <Ksl/Math.h>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+namespace Ksl {
+
+// Forward declarations, the default type is set in Array.h
+template <int D, typename T> class Array;
+template <typename Tp> class ArrayView;
+
+
+// Order of the elements of an Array<2> in memory
+enum ArrayLayout {
+    RowMajor,
+    ColumnMajor
+};
+
+// Layout of expressions with no 2D operand, and of
+// those mixing layouts, which can not be evaluated
+// element by element
+const int ArrayAnyLayout = -1;
+const int ArrayMixedLayout = -2;
+
+inline int combineLayouts(int l1, int l2) {
+    if (l1 == ArrayAnyLayout) return l2;
+    if (l2 == ArrayAnyLayout || l1 == l2) return l1;
+    return ArrayMixedLayout;
+}
+
+inline int checkedLayout(int layout) {
+    if (layout == ArrayMixedLayout) {
+        throw std::invalid_argument(
+            "Ksl: operands have different layouts, convert one with toLayout()");
+    }
+    return layout;
+}
+
+// Operands of element-wise operations must have the
+// same shape, or the same size if one of them is 1D.
+// Scalars match any shape
+template <typename L, typename R>
+inline void checkShape(const L &left, const R &right) {
+    if (L::Dim == 0 || R::Dim == 0) {
+        return;
+    }
+    bool same = (L::Dim == 2 && R::Dim == 2)
+        ? (left.rows() == right.rows() && left.cols() == right.cols())
+        : (left.size() == right.size());
+    if (!same) {
+        throw std::invalid_argument("Ksl: operands have different shapes");
+    }
+}
+
+
+/*********************************************
+ * Base class of all lazy array expressions.
+ * Expressions hold no storage, they are only
+ * evaluated, in a single loop, when assigned
+ * to an Array<1> or Array<2>. Because they may
+ * reference temporaries, do not keep them
+ * around with "auto", assign them to an array.
+ *********************************************/
+template <typename E>
+class ArrayExpr
+{
+public:
+
+    const E& self() const { return static_cast<const E&>(*this); }
+};
+
+
+/*********************************************
+ * Leaf expression that reads the elements of
+ * an array without touching its refcount
+ *********************************************/
+template <int D, typename Tp>
+class ArrayRef
+    : public ArrayExpr<ArrayRef<D,Tp>>
+{
+public:
+
+    typedef Tp value_type;
+    static const int Dim = D;
+
+    ArrayRef(const Tp *data, Index rows, Index cols,
+             int layout=ArrayAnyLayout)
+        : m_data(data), m_rows(rows), m_cols(cols), m_layout(layout)
+    { }
+
+    Index rows() const { return m_rows; }
+    Index cols() const { return m_cols; }
+    Index size() const { return m_rows*m_cols; }
+    int layout() const { return m_layout; }
+
+    const Tp& operator[] (Index idx) const { return m_data[idx]; }
+
+
+private:
+
+    const Tp *m_data;
+    Index m_rows;
+    Index m_cols;
+    int m_layout;
+};
+
+
+/*********************************************
+ * Leaf expression that reads the elements of
+ * a strided view, one every "stride" values
+ *********************************************/
+template <typename Tp>
+class ArrayStridedRef
+    : public ArrayExpr<ArrayStridedRef<Tp>>
+{
+public:
+
+    typedef Tp value_type;
+    static const int Dim = 1;
+
+    ArrayStridedRef(const Tp *data, Index size, Index stride)
+        : m_data(data), m_size(size), m_stride(stride)
+    { }
+
+    Index rows() const { return 1; }
+    Index cols() const { return m_size; }
+    Index size() const { return m_size; }
+    int layout() const { return ArrayAnyLayout; }
+
+    const Tp& operator[] (Index idx) const { return m_data[idx*m_stride]; }
+
+
+private:
+
+    const Tp *m_data;
+    Index m_size;
+    Index m_stride;
+};
+
+
+/*********************************************
+ * Leaf expression that broadcasts a scalar
+ * to every position of the result
+ *********************************************/
+template <typename Tp>
+class ArrayScalar
+    : public ArrayExpr<ArrayScalar<Tp>>
+{
+public:
+
+    typedef Tp value_type;
+    static const int Dim = 0;
+
+    ArrayScalar(const Tp &value)
+        : m_value(value)
+    { }
+
+    Index rows() const { return 0; }
+    Index cols() const { return 0; }
+    Index size() const { return 0; }
+    int layout() const { return ArrayAnyLayout; }
+
+    const Tp& operator[] (Index idx) const { (void) idx; return m_value; }
+
+
+private:
+
+    Tp m_value;
+};
+
+
+/*********************************************
+ * Element-wise binary and unary expressions.
+ * The shape is taken from the first operand
+ * that is not a scalar, the operands must
+ * agree on it, see checkShape().
+ *********************************************/
+template <typename Op, typename L, typename R>
+class ArrayBinary
+    : public ArrayExpr<ArrayBinary<Op,L,R>>
+{
+public:
+
+    typedef decltype(Op::apply(std::declval<typename L::value_type>(),
+                               std::declval<typename R::value_type>())) value_type;
+    static const int Dim = (L::Dim > R::Dim) ? L::Dim : R::Dim;
+
+    ArrayBinary(const L &left, const R &right)
+        : m_left(left), m_right(right)
+    {
+        checkShape(left, right);
+    }
+
+    Index rows() const { return L::Dim ? m_left.rows() : m_right.rows(); }
+    Index cols() const { return L::Dim ? m_left.cols() : m_right.cols(); }
+    Index size() const { return L::Dim ? m_left.size() : m_right.size(); }
+    int layout() const { return combineLayouts(m_left.layout(), m_right.layout()); }
+
+    value_type operator[] (Index idx) const {
+        return Op::apply(m_left[idx], m_right[idx]);
+    }
+
+
+private:
+
+    L m_left;
+    R m_right;
+};
+
+
+template <typename Op, typename E>
+class ArrayUnary
+    : public ArrayExpr<ArrayUnary<Op,E>>
+{
+public:
+
+    typedef decltype(Op::apply(std::declval<typename E::value_type>())) value_type;
+    static const int Dim = E::Dim;
+
+    ArrayUnary(const E &expr)
+        : m_expr(expr)
+    { }
+
+    Index rows() const { return m_expr.rows(); }
+    Index cols() const { return m_expr.cols(); }
+    Index size() const { return m_expr.size(); }
+    int layout() const { return m_expr.layout(); }
+
+    value_type operator[] (Index idx) const {
+        return Op::apply(m_expr[idx]);
+    }
+
+
+private:
+
+    E m_expr;
+};
+
+
+/*********************************************
+ * Maps operands (arrays, expressions and
+ * scalars) to expression nodes
+ *********************************************/
+template <typename T, typename Enable=void>
+struct ArrayOperand {
+    static const bool isArray = false;
+    static const bool isValid = false;
+};
+
+template <typename Tp>
+struct ArrayOperand<Array<1,Tp>> {
+    static const bool isArray = true;
+    static const bool isValid = true;
+    typedef ArrayRef<1,Tp> type;
+    static type make(const Array<1,Tp> &a) {
+        return type(a.begin(), 1, a.size());
+    }
+};
+
+template <typename Tp>
+struct ArrayOperand<Array<2,Tp>> {
+    static const bool isArray = true;
+    static const bool isValid = true;
+    typedef ArrayRef<2,Tp> type;
+    static type make(const Array<2,Tp> &a) {
+        return type(a.begin(), a.rows(), a.cols(), a.layout());
+    }
+};
+
+template <typename Tp>
+struct ArrayOperand<ArrayView<Tp>> {
+    static const bool isArray = true;
+    static const bool isValid = true;
+    typedef ArrayStridedRef<Tp> type;
+    static type make(const ArrayView<Tp> &v) {
+        return type(v.data(), v.size(), v.stride());
+    }
+};
+
+template <typename E>
+struct ArrayOperand<E, typename std::enable_if<
+    std::is_base_of<ArrayExpr<E>,E>::value>::type>
+{
+    static const bool isArray = true;
+    static const bool isValid = true;
+    typedef E type;
+    static const E& make(const E &e) { return e; }
+};
+
+template <typename Tp>
+struct ArrayOperand<Tp, typename std::enable_if<
+    std::is_arithmetic<Tp>::value>::type>
+{
+    static const bool isArray = false;
+    static const bool isValid = true;
+    typedef ArrayScalar<Tp> type;
+    static type make(const Tp &x) { return type(x); }
+};
+
+
+template <typename L, typename R>
+struct ArrayBinaryTraits {
+    static const bool enabled =
+        ArrayOperand<L>::isValid && ArrayOperand<R>::isValid &&
+        (ArrayOperand<L>::isArray || ArrayOperand<R>::isArray);
+};
+
+
+/*********************************************
+ * Element-wise operations
+ *********************************************/
+struct ArrayAddOp {
+    template <typename A, typename B> static inline
+    auto apply(const A &a, const B &b) -> decltype(a+b) { return a + b; }
+};
+
+struct ArraySubOp {
+    template <typename A, typename B> static inline
+    auto apply(const A &a, const B &b) -> decltype(a-b) { return a - b; }
+};
+
+struct ArrayMulOp {
+    template <typename A, typename B> static inline
+    auto apply(const A &a, const B &b) -> decltype(a*b) { return a * b; }
+};
+
+struct ArrayDivOp {
+    template <typename A, typename B> static inline
+    auto apply(const A &a, const B &b) -> decltype(a/b) { return a / b; }
+};
+
+struct ArrayNegOp {
+    template <typename A> static inline
+    auto apply(const A &a) -> decltype(-a) { return -a; }
+};
+
+struct ArrayPowOp {
+    template <typename A, typename B> static inline
+    auto apply(const A &a, const B &b) -> decltype(std::pow(a,b)) { return std::pow(a, b); }
+};
+
+
+#define KSL_ARRAY_BINARY_OPERATOR(Symbol, OpType) \
+    template <typename L, typename R> inline \
+    typename std::enable_if<ArrayBinaryTraits<L,R>::enabled, \
+        ArrayBinary<OpType, typename ArrayOperand<L>::type, \
+                            typename ArrayOperand<R>::type>>::type \
+    operator Symbol (const L &left, const R &right) { \
+        return ArrayBinary<OpType, typename ArrayOperand<L>::type, \
+                                   typename ArrayOperand<R>::type>( \
+            ArrayOperand<L>::make(left), ArrayOperand<R>::make(right)); \
+    }
+
+KSL_ARRAY_BINARY_OPERATOR(+, ArrayAddOp)
+KSL_ARRAY_BINARY_OPERATOR(-, ArraySubOp)
+KSL_ARRAY_BINARY_OPERATOR(*, ArrayMulOp)
+KSL_ARRAY_BINARY_OPERATOR(/, ArrayDivOp)
+
+#undef KSL_ARRAY_BINARY_OPERATOR
+
+
+template <typename E> inline
+typename std::enable_if<ArrayOperand<E>::isArray,
+    ArrayUnary<ArrayNegOp, typename ArrayOperand<E>::type>>::type
+operator- (const E &expr) {
+    return ArrayUnary<ArrayNegOp, typename ArrayOperand<E>::type>(
+        ArrayOperand<E>::make(expr));
+}
+
+
+template <typename L, typename R> inline
+typename std::enable_if<ArrayBinaryTraits<L,R>::enabled,
+    ArrayBinary<ArrayPowOp, typename ArrayOperand<L>::type,
+                            typename ArrayOperand<R>::type>>::type
+pow(const L &base, const R &exponent) {
+    return ArrayBinary<ArrayPowOp, typename ArrayOperand<L>::type,
+                                   typename ArrayOperand<R>::type>(
+        ArrayOperand<L>::make(base), ArrayOperand<R>::make(exponent));
+}
+
+
+/*********************************************
+ * Ksl::Math functions lifted to arrays, e.g.
+ *   Array<1> y = a*x + b*exp(x);
+ *********************************************/
+#define KSL_ARRAY_UNARY_FUNCTION(Name, Func) \
+    struct Array_##Name##_Op { \
+        template <typename A> static inline \
+        auto apply(const A &a) -> decltype(Func(a)) { return Func(a); } \
+    }; \
+    template <typename E> inline \
+    typename std::enable_if<ArrayOperand<E>::isArray, \
+        ArrayUnary<Array_##Name##_Op, typename ArrayOperand<E>::type>>::type \
+    Name(const E &expr) { \
+        return ArrayUnary<Array_##Name##_Op, typename ArrayOperand<E>::type>( \
+            ArrayOperand<E>::make(expr)); \
+    }
+
+KSL_ARRAY_UNARY_FUNCTION(sin, std::sin)
+KSL_ARRAY_UNARY_FUNCTION(cos, std::cos)
+KSL_ARRAY_UNARY_FUNCTION(tan, std::tan)
+KSL_ARRAY_UNARY_FUNCTION(asin, std::asin)
+KSL_ARRAY_UNARY_FUNCTION(acos, std::acos)
+KSL_ARRAY_UNARY_FUNCTION(atan, std::atan)
+KSL_ARRAY_UNARY_FUNCTION(exp, std::exp)
+KSL_ARRAY_UNARY_FUNCTION(log, std::log)
+KSL_ARRAY_UNARY_FUNCTION(log10, std::log10)
+KSL_ARRAY_UNARY_FUNCTION(sqrt, std::sqrt)
+KSL_ARRAY_UNARY_FUNCTION(abs, std::abs)
+KSL_ARRAY_UNARY_FUNCTION(pow2, Math::pow2)
+KSL_ARRAY_UNARY_FUNCTION(pow3, Math::pow3)
+KSL_ARRAY_UNARY_FUNCTION(pow4, Math::pow4)
+KSL_ARRAY_UNARY_FUNCTION(pow5, Math::pow5)
+KSL_ARRAY_UNARY_FUNCTION(pow6, Math::pow6)
+KSL_ARRAY_UNARY_FUNCTION(pow7, Math::pow7)
+KSL_ARRAY_UNARY_FUNCTION(pow8, Math::pow8)
+KSL_ARRAY_UNARY_FUNCTION(pow9, Math::pow9)
+KSL_ARRAY_UNARY_FUNCTION(pow10, Math::pow10)
+KSL_ARRAY_UNARY_FUNCTION(pow11, Math::pow11)
+KSL_ARRAY_UNARY_FUNCTION(pow12, Math::pow12)
+
+#undef KSL_ARRAY_UNARY_FUNCTION
+
+
+/*********************************************
+ * Expression evaluation. This is the only
+ * loop run for a whole expression tree
+ *********************************************/
+template <typename Tp, typename E> inline
+void evaluate(Tp *dest, const E &expr, Index size) {
+    for (Index k=0; k<size; ++k) {
+        dest[k] = Tp(expr[k]);
+    }
+}
+
+
+template <typename Op, typename Tp, typename E> inline
+void evaluate(Tp *dest, const E &expr, Index size, Op) {
+    for (Index k=0; k<size; ++k) {
+        dest[k] = Tp(Op::apply(dest[k], expr[k]));
+    }
+}
+
+
+template <typename E> inline
+Array<E::Dim, typename E::value_type> eval(const ArrayExpr<E> &expr) {
+    return Array<E::Dim, typename E::value_type>(expr);
+}
+
+} // namespace Ksl
+
+#endif // KSL_ARRAYEXPR_H
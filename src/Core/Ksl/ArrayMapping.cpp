@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2016  Elvis Teixeira
+ *
+ * This source code is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General
+ * Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This source code is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <Ksl/ArrayMapping.h>
+#include <QFile>
+#include <QDebug>
+
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif // Q_OS_UNIX
+
+namespace Ksl {
+
+ArrayMapping::ArrayMapping(char *base, qint64 length, char *data,
+                           qint64 size, Mode mode)
+    : m_base(base)
+    , m_length(length)
+    , m_data(data)
+    , m_size(size)
+    , m_mode(mode)
+{ }
+
+
+#ifdef Q_OS_UNIX
+
+ArrayMapping* ArrayMapping::map(const QString &filePath, qint64 offset,
+                                qint64 bytes, Mode mode)
+{
+    int fd = ::open(QFile::encodeName(filePath).constData(), O_RDONLY);
+    if (fd < 0) {
+        qDebug() << "ArrayMapping::map: File not found!";
+        return nullptr;
+    }
+    struct stat info;
+    if (::fstat(fd, &info) != 0 || offset < 0 || offset > qint64(info.st_size)) {
+        qDebug() << "ArrayMapping::map: Bad offset!";
+        ::close(fd);
+        return nullptr;
+    }
+    if (bytes < 0 || offset + bytes > qint64(info.st_size)) {
+        bytes = qint64(info.st_size) - offset;
+    }
+    if (bytes == 0) {
+        ::close(fd);
+        return nullptr;
+    }
+
+    // The mapping has to start at a page boundary
+    qint64 page = ::sysconf(_SC_PAGESIZE);
+    qint64 start = offset - offset % page;
+    qint64 length = bytes + (offset - start);
+    void *base = ::mmap(nullptr, size_t(length),
+        mode == ReadOnly ? PROT_READ : PROT_READ|PROT_WRITE,
+        mode == ReadOnly ? MAP_SHARED : MAP_PRIVATE,
+        fd, off_t(start));
+    ::close(fd);
+    if (base == MAP_FAILED) {
+        qDebug() << "ArrayMapping::map: mmap failed!";
+        return nullptr;
+    }
+    return new ArrayMapping((char*) base, length,
+                            (char*) base + (offset - start), bytes, mode);
+}
+
+
+ArrayMapping::~ArrayMapping() {
+    ::munmap(m_base, size_t(m_length));
+}
+
+#else // Q_OS_UNIX
+
+// Without mmap the region is read into memory
+ArrayMapping* ArrayMapping::map(const QString &filePath, qint64 offset,
+                                qint64 bytes, Mode mode)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qDebug() << "ArrayMapping::map: File not found!";
+        return nullptr;
+    }
+    if (offset < 0 || offset > file.size() || !file.seek(offset)) {
+        qDebug() << "ArrayMapping::map: Bad offset!";
+        return nullptr;
+    }
+    if (bytes < 0 || offset + bytes > file.size()) {
+        bytes = file.size() - offset;
+    }
+    if (bytes == 0) {
+        return nullptr;
+    }
+    char *data = (char*) qMallocAligned(size_t(bytes), KSL_ARRAY_ALIGNMENT);
+    if (!data || file.read(data, bytes) != bytes) {
+        qDebug() << "ArrayMapping::map: Read error!";
+        qFreeAligned(data);
+        return nullptr;
+    }
+    return new ArrayMapping(data, bytes, data, bytes, mode);
+}
+
+
+ArrayMapping::~ArrayMapping() {
+    qFreeAligned(m_base);
+}
+
+#endif // Q_OS_UNIX
+
+} // namespace Ksl
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2016  Elvis Teixeira
+ *
+ * This source code is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General
+ * Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This source code is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef KSL_ARRAYMAPPING_H
+#define KSL_ARRAYMAPPING_H
+
+#include <Ksl/Array.h>
+#include <QString>
+
+namespace Ksl {
+
+/*********************************************
+ * Mapping of a region of a binary file into
+ * memory. Pages are read by the system when
+ * first touched and, in read only mode, are
+ * shared with every process mapping the same
+ * file. Arrays created by mapArray() and
+ * mapMatrix() own their mapping and unmap it
+ * when the last of them goes away.
+ *********************************************/
+class KSL_EXPORT ArrayMapping
+    : public ArrayBufferOwner
+{
+public:
+
+    enum Mode {
+        // Arrays copy the data before the first write
+        ReadOnly,
+        // Writes go to private copies of the touched
+        // pages, the file is never changed
+        CopyOnWrite
+    };
+
+    // Maps "bytes" bytes of the file starting at
+    // "offset", or up to the end of the file if
+    // bytes < 0. Returns nullptr if it fails
+    static ArrayMapping* map(const QString &filePath, qint64 offset,
+                             qint64 bytes, Mode mode=ReadOnly);
+
+    ~ArrayMapping();
+
+    char* data() const { return m_data; }
+    qint64 size() const { return m_size; }
+    Mode mode() const { return m_mode; }
+
+
+private:
+
+    ArrayMapping(char *base, qint64 length, char *data,
+                 qint64 size, Mode mode);
+
+    char *m_base;
+    qint64 m_length;
+    char *m_data;
+    qint64 m_size;
+    Mode m_mode;
+};
+
+
+/*********************************************
+ * Arrays backed by a file holding the raw
+ * elements, after a header of "offset" bytes.
+ * They are empty if the file can't be mapped.
+ *********************************************/
+
+template <typename Tp=double> inline
+Array<1,Tp> mapArray(const QString &filePath, qint64 offset=0, Index size=-1,
+                     ArrayMapping::Mode mode=ArrayMapping::ReadOnly)
+{
+    if (offset % qint64(alignof(Tp)) != 0) {
+        return Array<1,Tp>();
+    }
+    ArrayMapping *mapping = ArrayMapping::map(filePath, offset,
+        size < 0 ? -1 : qint64(size)*qint64(sizeof(Tp)), mode);
+    if (!mapping) {
+        return Array<1,Tp>();
+    }
+    return Array<1,Tp>(new Array<0,Tp>(
+        1, Index(mapping->size() / qint64(sizeof(Tp))),
+        reinterpret_cast<Tp*>(mapping->data()), mapping,
+        mode == ArrayMapping::ReadOnly));
+}
+
+
+template <typename Tp=double> inline
+Array<2,Tp> mapMatrix(const QString &filePath, Index rows, Index cols,
+                      qint64 offset=0, ArrayLayout layout=RowMajor,
+                      ArrayMapping::Mode mode=ArrayMapping::ReadOnly)
+{
+    if (offset % qint64(alignof(Tp)) != 0 || rows <= 0 || cols <= 0 ||
+        qint64(rows) > std::numeric_limits<qint64>::max() / qint64(sizeof(Tp)) / qint64(cols))
+    {
+        return Array<2,Tp>();
+    }
+    // the mapping stops at the end of the file, which
+    // must hold all the elements
+    qint64 bytes = qint64(rows)*qint64(cols)*qint64(sizeof(Tp));
+    ArrayMapping *mapping = ArrayMapping::map(filePath, offset, bytes, mode);
+    if (!mapping || mapping->size() < bytes) {
+        delete mapping;
+        return Array<2,Tp>();
+    }
+    auto storage = new Array<0,Tp>(
+        rows, cols, reinterpret_cast<Tp*>(mapping->data()), mapping,
+        mode == ArrayMapping::ReadOnly);
+    storage->setLayout(layout);
+    return Array<2,Tp>(storage);
+}
+
+} // namespace Ksl
+
+#endif // KSL_ARRAYMAPPING_H
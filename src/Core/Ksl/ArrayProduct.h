@@ -0,0 +1,348 @@
+/*
+ * Copyright (C) 2016  Elvis Teixeira
+ *
+ * This source code is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General
+ * Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This source code is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef KSL_ARRAYPRODUCT_H
+#define KSL_ARRAYPRODUCT_H
+
+#include <Ksl/ArrayReduce.h>
+#include <Ksl/ThreadPool.h>
+#include <stdexcept>
+#include <vector>
+
+#if defined(KSL_REDUCE_AVX)
+#define KSL_PRODUCT_AVX
+#endif
+
+namespace Ksl {
+
+/*********************************************
+ * Read only description of a matrix operand
+ * of the products: element (i,j) is found at
+ * data[i*rowStride + j*colStride], so a
+ * transposed matrix or a block is described
+ * without moving any data. It does not hold
+ * a reference to the storage, use it only as
+ * a function argument.
+ *********************************************/
+template <typename Tp>
+class ArrayMatrix
+{
+public:
+
+    typedef Tp value_type;
+
+    ArrayMatrix(const Tp *data, Index rows, Index cols,
+                Index rowStride, Index colStride)
+        : m_data(data), m_rows(rows), m_cols(cols)
+        , m_rowStride(rowStride), m_colStride(colStride)
+    { }
+
+    ArrayMatrix(const Array<2,Tp> &matrix)
+        : ArrayMatrix(matrix.begin(), matrix.rows(), matrix.cols(),
+                      matrix.layout() == RowMajor ? matrix.cols() : 1,
+                      matrix.layout() == RowMajor ? 1 : matrix.rows())
+    { }
+
+    ArrayMatrix(const ArrayBlock<Tp> &block)
+        : ArrayMatrix(block.data(), block.rows(), block.cols(),
+                      block.rowStride(), block.colStride())
+    { }
+
+    const Tp* data() const { return m_data; }
+    Index rows() const { return m_rows; }
+    Index cols() const { return m_cols; }
+    Index rowStride() const { return m_rowStride; }
+    Index colStride() const { return m_colStride; }
+
+    const Tp& operator() (Index i, Index j) const {
+        return m_data[i*m_rowStride + j*m_colStride];
+    }
+
+    ArrayMatrix transposed() const {
+        return ArrayMatrix(m_data, m_cols, m_rows, m_colStride, m_rowStride);
+    }
+
+
+private:
+
+    const Tp *m_data;
+    Index m_rows;
+    Index m_cols;
+    Index m_rowStride;
+    Index m_colStride;
+};
+
+
+// Transposed operand for matmul and matvec, nothing is copied
+template <typename Tp> inline
+ArrayMatrix<Tp> trans(const Array<2,Tp> &matrix) {
+    return ArrayMatrix<Tp>(matrix).transposed();
+}
+
+template <typename Tp> inline
+ArrayMatrix<Tp> trans(const ArrayBlock<Tp> &block) {
+    return ArrayMatrix<Tp>(block).transposed();
+}
+
+template <typename Tp> inline
+ArrayMatrix<Tp> trans(const ArrayMatrix<Tp> &matrix) {
+    return matrix.transposed();
+}
+
+
+/*********************************************
+ * Blocked matrix product. The classic scheme:
+ * panels of B (KC x NC) and of A (MC x KC)
+ * are packed in the order the micro-kernel
+ * reads them, so it streams contiguous memory
+ * from L1/L2 while an MR x NR block of C is
+ * held in registers. Padding the packs with
+ * zeros lets the kernel ignore the edges.
+ *********************************************/
+struct ArrayProductBlocking {
+    static const Index MR = 4;
+    static const Index NR = 8;
+    static const Index KC = 256;
+    static const Index MC = 96;
+    static const Index NC = 2048;
+};
+
+
+template <typename Tp> inline
+void gemmPackA(const ArrayMatrix<Tp> &a, Index i0, Index mc,
+               Index p0, Index kc, Tp *dest)
+{
+    const Index MR = ArrayProductBlocking::MR;
+    for (Index ir=0; ir<mc; ir+=MR) {
+        for (Index p=0; p<kc; ++p) {
+            for (Index i=0; i<MR; ++i) {
+                *dest++ = (ir+i < mc) ? a(i0+ir+i, p0+p) : Tp(0);
+            }
+        }
+    }
+}
+
+
+template <typename Tp> inline
+void gemmPackB(const ArrayMatrix<Tp> &b, Index p0, Index kc,
+               Index j0, Index nc, Tp *dest)
+{
+    const Index NR = ArrayProductBlocking::NR;
+    for (Index jr=0; jr<nc; jr+=NR) {
+        for (Index p=0; p<kc; ++p) {
+            for (Index j=0; j<NR; ++j) {
+                *dest++ = (jr+j < nc) ? b(p0+p, j0+jr+j) : Tp(0);
+            }
+        }
+    }
+}
+
+
+// C[0:mr,0:nr] += A * B for one packed strip of
+// A (kc x MR) and one of B (kc x NR)
+template <typename Tp> inline
+void gemmMicroKernel(Index kc, const Tp *a, const Tp *b,
+                     Tp *c, Index ldc, Index mr, Index nr)
+{
+    const Index MR = ArrayProductBlocking::MR;
+    const Index NR = ArrayProductBlocking::NR;
+    Tp ab[MR][NR];
+    for (Index i=0; i<MR; ++i) {
+        for (Index j=0; j<NR; ++j) {
+            ab[i][j] = Tp(0);
+        }
+    }
+    for (Index p=0; p<kc; ++p) {
+        for (Index i=0; i<MR; ++i) {
+            for (Index j=0; j<NR; ++j) {
+                ab[i][j] += a[i]*b[j];
+            }
+        }
+        a += MR;
+        b += NR;
+    }
+    for (Index i=0; i<mr; ++i) {
+        for (Index j=0; j<nr; ++j) {
+            c[i*ldc + j] += ab[i][j];
+        }
+    }
+}
+
+
+#if defined(KSL_PRODUCT_AVX)
+
+inline __m256d gemmFma(__m256d a, __m256d b, __m256d c) {
+#if defined(__FMA__)
+    return _mm256_fmadd_pd(a, b, c);
+#else
+    return _mm256_add_pd(_mm256_mul_pd(a, b), c);
+#endif
+}
+
+
+inline void gemmMicroKernel(Index kc, const double *a, const double *b,
+                            double *c, Index ldc, Index mr, Index nr)
+{
+    __m256d c00 = _mm256_setzero_pd(), c01 = c00;
+    __m256d c10 = c00, c11 = c00, c20 = c00, c21 = c00;
+    __m256d c30 = c00, c31 = c00;
+    for (Index p=0; p<kc; ++p) {
+        __m256d b0 = _mm256_loadu_pd(b);
+        __m256d b1 = _mm256_loadu_pd(b+4);
+        __m256d ai = _mm256_broadcast_sd(a);
+        c00 = gemmFma(ai, b0, c00);
+        c01 = gemmFma(ai, b1, c01);
+        ai = _mm256_broadcast_sd(a+1);
+        c10 = gemmFma(ai, b0, c10);
+        c11 = gemmFma(ai, b1, c11);
+        ai = _mm256_broadcast_sd(a+2);
+        c20 = gemmFma(ai, b0, c20);
+        c21 = gemmFma(ai, b1, c21);
+        ai = _mm256_broadcast_sd(a+3);
+        c30 = gemmFma(ai, b0, c30);
+        c31 = gemmFma(ai, b1, c31);
+        a += 4;
+        b += 8;
+    }
+    alignas(32) double ab[4][8];
+    _mm256_store_pd(ab[0], c00); _mm256_store_pd(ab[0]+4, c01);
+    _mm256_store_pd(ab[1], c10); _mm256_store_pd(ab[1]+4, c11);
+    _mm256_store_pd(ab[2], c20); _mm256_store_pd(ab[2]+4, c21);
+    _mm256_store_pd(ab[3], c30); _mm256_store_pd(ab[3]+4, c31);
+    for (Index i=0; i<mr; ++i) {
+        for (Index j=0; j<nr; ++j) {
+            c[i*ldc + j] += ab[i][j];
+        }
+    }
+}
+
+#endif // KSL_PRODUCT_AVX
+
+
+// Rows [m0,m1) of C = A * B, C must be zeroed
+template <typename Tp>
+void gemmRows(const ArrayMatrix<Tp> &a, const ArrayMatrix<Tp> &b,
+              Tp *c, Index m0, Index m1)
+{
+    const Index MR = ArrayProductBlocking::MR;
+    const Index NR = ArrayProductBlocking::NR;
+    const Index KC = ArrayProductBlocking::KC;
+    const Index MC = ArrayProductBlocking::MC;
+    const Index NC = ArrayProductBlocking::NC;
+    const Index K = a.cols();
+    const Index N = b.cols();
+
+    std::vector<Tp> packA(MC*KC);
+    std::vector<Tp> packB(std::min(KC, K) * ((std::min(NC, N) + NR - 1)/NR*NR));
+
+    for (Index jc=0; jc<N; jc+=NC) {
+        Index nc = std::min(NC, N - jc);
+        for (Index pc=0; pc<K; pc+=KC) {
+            Index kc = std::min(KC, K - pc);
+            gemmPackB(b, pc, kc, jc, nc, packB.data());
+            for (Index ic=m0; ic<m1; ic+=MC) {
+                Index mc = std::min(MC, m1 - ic);
+                gemmPackA(a, ic, mc, pc, kc, packA.data());
+                for (Index jr=0; jr<nc; jr+=NR) {
+                    for (Index ir=0; ir<mc; ir+=MR) {
+                        gemmMicroKernel(kc, packA.data() + ir*kc,
+                                        packB.data() + jr*kc,
+                                        c + (ic+ir)*N + jc + jr, N,
+                                        std::min(MR, mc - ir),
+                                        std::min(NR, nc - jr));
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+template <typename Tp>
+Array<2,Tp> matmul(const ArrayMatrix<Tp> &a, const ArrayMatrix<Tp> &b) {
+    if (a.cols() != b.rows()) {
+        throw std::invalid_argument("Ksl::matmul: inner dimensions differ");
+    }
+    Array<2,Tp> ret(a.rows(), b.cols(), Tp(0));
+    if (ret.size() == 0 || a.cols() == 0) {
+        return ret;
+    }
+    Tp *c = ret.begin();
+    // Each range of rows of C packs its own B panels, which
+    // costs little next to its share of the product
+    Index work = a.cols()*b.cols();
+    Index grain = std::max(Index(ArrayProductBlocking::MC),
+                           Index(1 << 22)/std::max(work, Index(1)));
+    ThreadPool::global().parallelFor(a.rows(), grain, [&](Index m0, Index m1) {
+        gemmRows(a, b, c, m0, m1);
+    });
+    return ret;
+}
+
+
+/*********************************************
+ * Matrix products. Operands are Array<2>,
+ * ArrayBlock or trans() of them, vectors are
+ * Array<1> or ArrayView.
+ *********************************************/
+template <typename A, typename B> inline
+Array<2,typename A::value_type> matmul(const A &a, const B &b) {
+    typedef typename A::value_type Tp;
+    return matmul(ArrayMatrix<Tp>(a), ArrayMatrix<Tp>(b));
+}
+
+
+template <typename A> inline
+Array<1,typename A::value_type>
+matvec(const A &a, const ArrayView<typename A::value_type> &x)
+{
+    typedef typename A::value_type Tp;
+    ArrayMatrix<Tp> m(a);
+    if (m.cols() != x.size()) {
+        throw std::invalid_argument("Ksl::matvec: dimensions differ");
+    }
+    Array<1,Tp> ret(m.rows(), Tp(0));
+    Tp *y = ret.begin();
+    Index grain = std::max(Index(1024), Index(1 << 18)/std::max(m.cols(), Index(1)));
+    ThreadPool::global().parallelFor(m.rows(), grain, [&](Index i0, Index i1) {
+        if (m.colStride() == 1 || m.rowStride() != 1) {
+            // Row major: one dot product per row
+            for (Index i=i0; i<i1; ++i) {
+                y[i] = dot(m.data() + i*m.rowStride(), x.data(), m.cols(),
+                           m.colStride(), x.stride());
+            }
+        } else {
+            // Column major (transposed): accumulate columns,
+            // each one a contiguous run of the rows
+            for (Index j=0; j<m.cols(); ++j) {
+                const Tp *column = m.data() + j*m.colStride();
+                const Tp xj = x[j];
+                for (Index i=i0; i<i1; ++i) {
+                    y[i] += column[i]*xj;
+                }
+            }
+        }
+    });
+    return ret;
+}
+
+} // namespace Ksl
+
+#endif // KSL_ARRAYPRODUCT_H
@@ -0,0 +1,443 @@
+/*
+ * Copyright (C) 2016  Elvis Teixeira
+ *
+ * This source code is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General
+ * Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This source code is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef KSL_ARRAYREDUCE_H
+#define KSL_ARRAYREDUCE_H
+
+#include <Ksl/Array.h>
+#include <stdexcept>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define KSL_REDUCE_AVX
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define KSL_REDUCE_SSE2
+#endif
+
+namespace Ksl {
+
+/*********************************************
+ * Reduction kernels over raw memory. Generic
+ * versions are used for any element type and
+ * for strided data, contiguous doubles go to
+ * SIMD versions selected at compile time
+ * (build with -mavx to get the AVX ones).
+ *********************************************/
+
+template <typename Tp> inline
+Tp sumKernel(const Tp *data, Index size) {
+    Tp s0=Tp(0), s1=Tp(0), s2=Tp(0), s3=Tp(0);
+    Index k = 0;
+    for (; k+4<=size; k+=4) {
+        s0 += data[k];
+        s1 += data[k+1];
+        s2 += data[k+2];
+        s3 += data[k+3];
+    }
+    for (; k<size; ++k) {
+        s0 += data[k];
+    }
+    return (s0 + s1) + (s2 + s3);
+}
+
+
+template <typename Tp> inline
+Tp dotKernel(const Tp *a, const Tp *b, Index size) {
+    Tp s0=Tp(0), s1=Tp(0), s2=Tp(0), s3=Tp(0);
+    Index k = 0;
+    for (; k+4<=size; k+=4) {
+        s0 += a[k]*b[k];
+        s1 += a[k+1]*b[k+1];
+        s2 += a[k+2]*b[k+2];
+        s3 += a[k+3]*b[k+3];
+    }
+    for (; k<size; ++k) {
+        s0 += a[k]*b[k];
+    }
+    return (s0 + s1) + (s2 + s3);
+}
+
+
+template <typename Tp> inline
+void minmaxKernel(const Tp *data, Index size, Tp &min, Tp &max) {
+    min = max = data[0];
+    for (Index k=1; k<size; ++k) {
+        if (data[k] < min) min = data[k];
+        if (data[k] > max) max = data[k];
+    }
+}
+
+
+#if defined(KSL_REDUCE_AVX)
+
+inline double hsum(__m256d v) {
+    __m128d h = _mm_add_pd(_mm256_castpd256_pd128(v),
+                           _mm256_extractf128_pd(v, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(h, _mm_unpackhi_pd(h, h)));
+}
+
+
+inline double sumKernel(const double *data, Index size) {
+    __m256d s0 = _mm256_setzero_pd(), s1 = s0, s2 = s0, s3 = s0;
+    Index k = 0;
+    for (; k+16<=size; k+=16) {
+        s0 = _mm256_add_pd(s0, _mm256_loadu_pd(data+k));
+        s1 = _mm256_add_pd(s1, _mm256_loadu_pd(data+k+4));
+        s2 = _mm256_add_pd(s2, _mm256_loadu_pd(data+k+8));
+        s3 = _mm256_add_pd(s3, _mm256_loadu_pd(data+k+12));
+    }
+    for (; k+4<=size; k+=4) {
+        s0 = _mm256_add_pd(s0, _mm256_loadu_pd(data+k));
+    }
+    double s = hsum(_mm256_add_pd(_mm256_add_pd(s0, s1),
+                                  _mm256_add_pd(s2, s3)));
+    for (; k<size; ++k) {
+        s += data[k];
+    }
+    return s;
+}
+
+
+inline double dotKernel(const double *a, const double *b, Index size) {
+    __m256d s0 = _mm256_setzero_pd(), s1 = s0, s2 = s0, s3 = s0;
+    Index k = 0;
+    for (; k+16<=size; k+=16) {
+        s0 = _mm256_add_pd(s0, _mm256_mul_pd(_mm256_loadu_pd(a+k), _mm256_loadu_pd(b+k)));
+        s1 = _mm256_add_pd(s1, _mm256_mul_pd(_mm256_loadu_pd(a+k+4), _mm256_loadu_pd(b+k+4)));
+        s2 = _mm256_add_pd(s2, _mm256_mul_pd(_mm256_loadu_pd(a+k+8), _mm256_loadu_pd(b+k+8)));
+        s3 = _mm256_add_pd(s3, _mm256_mul_pd(_mm256_loadu_pd(a+k+12), _mm256_loadu_pd(b+k+12)));
+    }
+    for (; k+4<=size; k+=4) {
+        s0 = _mm256_add_pd(s0, _mm256_mul_pd(_mm256_loadu_pd(a+k), _mm256_loadu_pd(b+k)));
+    }
+    double s = hsum(_mm256_add_pd(_mm256_add_pd(s0, s1),
+                                  _mm256_add_pd(s2, s3)));
+    for (; k<size; ++k) {
+        s += a[k]*b[k];
+    }
+    return s;
+}
+
+
+inline void minmaxKernel(const double *data, Index size, double &min, double &max) {
+    // The loaded value goes first so that NaNs are skipped
+    // like in the scalar comparison
+    __m256d vmin = _mm256_set1_pd(data[0]), vmax = vmin;
+    Index k = 0;
+    for (; k+4<=size; k+=4) {
+        __m256d v = _mm256_loadu_pd(data+k);
+        vmin = _mm256_min_pd(v, vmin);
+        vmax = _mm256_max_pd(v, vmax);
+    }
+    __m128d lo = _mm_min_pd(_mm256_castpd256_pd128(vmin),
+                            _mm256_extractf128_pd(vmin, 1));
+    __m128d hi = _mm_max_pd(_mm256_castpd256_pd128(vmax),
+                            _mm256_extractf128_pd(vmax, 1));
+    min = _mm_cvtsd_f64(_mm_min_sd(_mm_unpackhi_pd(lo, lo), lo));
+    max = _mm_cvtsd_f64(_mm_max_sd(_mm_unpackhi_pd(hi, hi), hi));
+    for (; k<size; ++k) {
+        if (data[k] < min) min = data[k];
+        if (data[k] > max) max = data[k];
+    }
+}
+
+#elif defined(KSL_REDUCE_SSE2)
+
+inline double hsum(__m128d v) {
+    return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v)));
+}
+
+
+inline double sumKernel(const double *data, Index size) {
+    __m128d s0 = _mm_setzero_pd(), s1 = s0, s2 = s0, s3 = s0;
+    Index k = 0;
+    for (; k+8<=size; k+=8) {
+        s0 = _mm_add_pd(s0, _mm_loadu_pd(data+k));
+        s1 = _mm_add_pd(s1, _mm_loadu_pd(data+k+2));
+        s2 = _mm_add_pd(s2, _mm_loadu_pd(data+k+4));
+        s3 = _mm_add_pd(s3, _mm_loadu_pd(data+k+6));
+    }
+    for (; k+2<=size; k+=2) {
+        s0 = _mm_add_pd(s0, _mm_loadu_pd(data+k));
+    }
+    double s = hsum(_mm_add_pd(_mm_add_pd(s0, s1), _mm_add_pd(s2, s3)));
+    for (; k<size; ++k) {
+        s += data[k];
+    }
+    return s;
+}
+
+
+inline double dotKernel(const double *a, const double *b, Index size) {
+    __m128d s0 = _mm_setzero_pd(), s1 = s0, s2 = s0, s3 = s0;
+    Index k = 0;
+    for (; k+8<=size; k+=8) {
+        s0 = _mm_add_pd(s0, _mm_mul_pd(_mm_loadu_pd(a+k), _mm_loadu_pd(b+k)));
+        s1 = _mm_add_pd(s1, _mm_mul_pd(_mm_loadu_pd(a+k+2), _mm_loadu_pd(b+k+2)));
+        s2 = _mm_add_pd(s2, _mm_mul_pd(_mm_loadu_pd(a+k+4), _mm_loadu_pd(b+k+4)));
+        s3 = _mm_add_pd(s3, _mm_mul_pd(_mm_loadu_pd(a+k+6), _mm_loadu_pd(b+k+6)));
+    }
+    for (; k+2<=size; k+=2) {
+        s0 = _mm_add_pd(s0, _mm_mul_pd(_mm_loadu_pd(a+k), _mm_loadu_pd(b+k)));
+    }
+    double s = hsum(_mm_add_pd(_mm_add_pd(s0, s1), _mm_add_pd(s2, s3)));
+    for (; k<size; ++k) {
+        s += a[k]*b[k];
+    }
+    return s;
+}
+
+
+inline void minmaxKernel(const double *data, Index size, double &min, double &max) {
+    // The loaded value goes first so that NaNs are skipped
+    // like in the scalar comparison
+    __m128d vmin = _mm_set1_pd(data[0]), vmax = vmin;
+    Index k = 0;
+    for (; k+2<=size; k+=2) {
+        __m128d v = _mm_loadu_pd(data+k);
+        vmin = _mm_min_pd(v, vmin);
+        vmax = _mm_max_pd(v, vmax);
+    }
+    min = _mm_cvtsd_f64(_mm_min_sd(_mm_unpackhi_pd(vmin, vmin), vmin));
+    max = _mm_cvtsd_f64(_mm_max_sd(_mm_unpackhi_pd(vmax, vmax), vmax));
+    for (; k<size; ++k) {
+        if (data[k] < min) min = data[k];
+        if (data[k] > max) max = data[k];
+    }
+}
+
+#endif // KSL_REDUCE_AVX
+
+
+/*********************************************
+ * Reductions over raw (possibly strided)
+ * memory, min/max ones require size > 0
+ *********************************************/
+
+template <typename Tp> inline
+Tp sum(const Tp *data, Index size, Index stride=1) {
+    if (stride == 1) {
+        return sumKernel(data, size);
+    }
+    Tp s = Tp(0);
+    for (Index k=0; k<size; ++k) {
+        s += data[k*stride];
+    }
+    return s;
+}
+
+
+template <typename Tp> inline
+Tp dot(const Tp *a, const Tp *b, Index size,
+       Index strideA=1, Index strideB=1)
+{
+    if (strideA == 1 && strideB == 1) {
+        return dotKernel(a, b, size);
+    }
+    Tp s = Tp(0);
+    for (Index k=0; k<size; ++k) {
+        s += a[k*strideA] * b[k*strideB];
+    }
+    return s;
+}
+
+
+template <typename Tp> inline
+void minmax(const Tp *data, Index size, Index stride, Tp &min, Tp &max) {
+    if (stride == 1) {
+        minmaxKernel(data, size, min, max);
+        return;
+    }
+    min = max = data[0];
+    for (Index k=1; k<size; ++k) {
+        const Tp &x = data[k*stride];
+        if (x < min) min = x;
+        if (x > max) max = x;
+    }
+}
+
+
+// Finding the extreme value with the vector kernel and
+// then searching for its first occurrence is faster than
+// tracking indexes along the way
+template <typename Tp> inline
+Index argmin(const Tp *data, Index size, Index stride=1) {
+    Tp min, max;
+    minmax(data, size, stride, min, max);
+    for (Index k=0; k<size; ++k) {
+        if (data[k*stride] == min) return k;
+    }
+    return 0;
+}
+
+
+template <typename Tp> inline
+Index argmax(const Tp *data, Index size, Index stride=1) {
+    Tp min, max;
+    minmax(data, size, stride, min, max);
+    for (Index k=0; k<size; ++k) {
+        if (data[k*stride] == max) return k;
+    }
+    return 0;
+}
+
+
+/*********************************************
+ * Gives the reductions uniform access to the
+ * memory of arrays and views
+ *********************************************/
+template <typename A>
+struct ArrayTraits {};
+
+template <typename Tp>
+struct ArrayTraits<Array<1,Tp>> {
+    typedef Tp value_type;
+    static const Tp* data(const Array<1,Tp> &a) { return a.begin(); }
+    static Index size(const Array<1,Tp> &a) { return a.size(); }
+    static Index stride(const Array<1,Tp> &a) { (void) a; return 1; }
+};
+
+template <typename Tp>
+struct ArrayTraits<Array<2,Tp>> {
+    typedef Tp value_type;
+    static const Tp* data(const Array<2,Tp> &a) { return a.begin(); }
+    static Index size(const Array<2,Tp> &a) { return a.size(); }
+    static Index stride(const Array<2,Tp> &a) { (void) a; return 1; }
+};
+
+template <typename Tp>
+struct ArrayTraits<ArrayView<Tp>> {
+    typedef Tp value_type;
+    static const Tp* data(const ArrayView<Tp> &a) { return a.data(); }
+    static Index size(const ArrayView<Tp> &a) { return a.size(); }
+    static Index stride(const ArrayView<Tp> &a) { return a.stride(); }
+};
+
+
+/*********************************************
+ * Reductions over Array<1>, Array<2> (all the
+ * elements) and ArrayView. dot() needs arrays
+ * of the same size and the min/max ones need
+ * a non empty array, they throw otherwise
+ *********************************************/
+
+inline void checkReduceSizes(Index sizeA, Index sizeB) {
+    if (sizeA != sizeB) {
+        throw std::invalid_argument("Ksl: operands have different sizes");
+    }
+}
+
+
+inline void checkReduceNotEmpty(Index size) {
+    if (size <= 0) {
+        throw std::invalid_argument("Ksl: empty array has no min or max");
+    }
+}
+
+
+template <typename A> inline
+typename ArrayTraits<A>::value_type sum(const A &a) {
+    typedef ArrayTraits<A> T;
+    return sum(T::data(a), T::size(a), T::stride(a));
+}
+
+
+template <typename A> inline
+typename ArrayTraits<A>::value_type dot(const A &a, const A &b) {
+    typedef ArrayTraits<A> T;
+    checkReduceSizes(T::size(a), T::size(b));
+    return dot(T::data(a), T::data(b), T::size(a),
+               T::stride(a), T::stride(b));
+}
+
+
+template <typename A> inline
+typename ArrayTraits<A>::value_type min(const A &a) {
+    typedef ArrayTraits<A> T;
+    typename T::value_type min, max;
+    checkReduceNotEmpty(T::size(a));
+    minmax(T::data(a), T::size(a), T::stride(a), min, max);
+    return min;
+}
+
+
+template <typename A> inline
+typename ArrayTraits<A>::value_type max(const A &a) {
+    typedef ArrayTraits<A> T;
+    typename T::value_type min, max;
+    checkReduceNotEmpty(T::size(a));
+    minmax(T::data(a), T::size(a), T::stride(a), min, max);
+    return max;
+}
+
+
+template <typename A> inline
+void minmax(const A &a, typename ArrayTraits<A>::value_type &min,
+            typename ArrayTraits<A>::value_type &max)
+{
+    typedef ArrayTraits<A> T;
+    checkReduceNotEmpty(T::size(a));
+    minmax(T::data(a), T::size(a), T::stride(a), min, max);
+}
+
+
+template <typename A> inline
+typename std::enable_if<sizeof(typename ArrayTraits<A>::value_type) != 0, Index>::type
+argmin(const A &a) {
+    typedef ArrayTraits<A> T;
+    checkReduceNotEmpty(T::size(a));
+    return argmin(T::data(a), T::size(a), T::stride(a));
+}
+
+
+template <typename A> inline
+typename std::enable_if<sizeof(typename ArrayTraits<A>::value_type) != 0, Index>::type
+argmax(const A &a) {
+    typedef ArrayTraits<A> T;
+    checkReduceNotEmpty(T::size(a));
+    return argmax(T::data(a), T::size(a), T::stride(a));
+}
+
+
+template <typename A> inline
+typename std::enable_if<sizeof(typename ArrayTraits<A>::value_type) != 0, double>::type
+norm(const A &a) {
+    typedef ArrayTraits<A> T;
+    return std::sqrt(double(dot(T::data(a), T::data(a),
+                                T::size(a), T::stride(a), T::stride(a))));
+}
+
+
+// Expressions are reduced on the fly, without
+// ever being stored
+template <typename E> inline
+typename E::value_type sum(const ArrayExpr<E> &expr) {
+    const E &e = expr.self();
+    typename E::value_type s = typename E::value_type(0);
+    for (Index k=0; k<e.size(); ++k) {
+        s += e[k];
+    }
+    return s;
+}
+
+} // namespace Ksl
+
+#endif // KSL_ARRAYREDUCE_H
@@ -0,0 +1,281 @@
+/*
+ * Copyright (C) 2016  Elvis Teixeira
+ *
+ * This source code is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General
+ * Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This source code is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef KSL_ARRAYRING_H
+#define KSL_ARRAYRING_H
+
+#include <Ksl/Array.h>
+
+namespace Ksl {
+
+/*********************************************
+ * Fixed capacity circular array for live
+ * series: push() is O(1) and, once full,
+ * overwrites the oldest sample, so memory
+ * stays bounded. Element 0 is the oldest.
+ *
+ * Every sample is stored twice, at p and at
+ * p + capacity, so the latest n samples are
+ * always contiguous in the buffer and are
+ * handed out as ArrayViews without copies:
+ *   RingArray<> t(4096), y(4096);
+ *   ...
+ *   plot->setData(t.view(), y.view());
+ * Like arrays, rings share their buffer with
+ * the views taken from them and copy it on
+ * the next write, at most once per view.
+ *********************************************/
+template <typename Tp=double>
+class RingArray
+{
+public:
+
+    typedef Tp value_type;
+
+    explicit RingArray(Index capacity=0,
+                       ArrayAllocator &allocator=ArrayAllocator::current());
+    RingArray(const RingArray &that);
+    RingArray(RingArray &&that);
+    ~RingArray();
+
+    RingArray& operator= (const RingArray &that);
+    RingArray& operator= (RingArray &&that);
+
+    Index capacity() const { return m_capacity; }
+    Index size() const { return m_size; }
+    bool isEmpty() const { return m_size == 0; }
+    bool isFull() const { return m_size == m_capacity; }
+
+    // Samples pushed since creation or clear(), counting
+    // the overwritten ones, e.g. the index of the next one
+    qint64 total() const { return m_total; }
+
+    const Tp& operator[] (Index idx) const { return data()[idx]; }
+    const Tp& front() const { return data()[0]; }
+    const Tp& back() const { return data()[m_size-1]; }
+
+    // The size() samples, oldest first, contiguous
+    const Tp* data() const {
+        return m_storage ? m_storage->begin() + (m_head - m_size + m_capacity) : nullptr;
+    }
+
+    void push(const Tp &value);
+
+    // Pushes many samples, only the last capacity()
+    // ones are kept if there are more
+    void pushN(const Tp *values, Index count);
+    void pushN(const ArrayView<Tp> &values);
+
+    void clear();
+
+    // Zero-copy view of the n latest samples
+    ArrayView<Tp> last(Index n) const;
+
+    ArrayView<Tp> view() const { return last(m_size); }
+
+    Array<1,Tp> toArray() const;
+
+
+private:
+
+    void detach();
+
+    // Writes count <= capacity values at the head
+    void write(const Tp *values, Index count);
+
+    Array<0,Tp> *m_storage;
+    Index m_capacity;
+    Index m_size;
+    Index m_head;
+    qint64 m_total;
+};
+
+
+template <typename Tp>
+RingArray<Tp>::RingArray(Index capacity, ArrayAllocator &allocator)
+    : m_storage(nullptr), m_capacity(capacity > 0 ? capacity : 0)
+    , m_size(0), m_head(0), m_total(0)
+{
+    if (m_capacity > 0) {
+        m_storage = new (allocator) Array<0,Tp>(1, 2*m_capacity, allocator);
+    }
+}
+
+
+template <typename Tp>
+RingArray<Tp>::RingArray(const RingArray<Tp> &that)
+    : m_storage(that.m_storage ? that.m_storage->ref() : nullptr)
+    , m_capacity(that.m_capacity), m_size(that.m_size)
+    , m_head(that.m_head), m_total(that.m_total)
+{ }
+
+
+template <typename Tp>
+RingArray<Tp>::RingArray(RingArray<Tp> &&that)
+    : m_storage(that.m_storage), m_capacity(that.m_capacity)
+    , m_size(that.m_size), m_head(that.m_head), m_total(that.m_total)
+{
+    that.m_storage = nullptr;
+    that.m_capacity = that.m_size = that.m_head = 0;
+    that.m_total = 0;
+}
+
+
+template <typename Tp>
+RingArray<Tp>::~RingArray() {
+    if (m_storage && m_storage->unref()) {
+        delete m_storage;
+    }
+}
+
+
+template <typename Tp>
+RingArray<Tp>& RingArray<Tp>::operator= (const RingArray<Tp> &that) {
+    if (this != &that) {
+        RingArray<Tp> copy(that);
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+
+template <typename Tp>
+RingArray<Tp>& RingArray<Tp>::operator= (RingArray<Tp> &&that) {
+    if (this != &that) {
+        if (m_storage && m_storage->unref()) {
+            delete m_storage;
+        }
+        m_storage = that.m_storage;
+        m_capacity = that.m_capacity;
+        m_size = that.m_size;
+        m_head = that.m_head;
+        m_total = that.m_total;
+        that.m_storage = nullptr;
+        that.m_capacity = that.m_size = that.m_head = 0;
+        that.m_total = 0;
+    }
+    return *this;
+}
+
+
+template <typename Tp>
+void RingArray<Tp>::detach() {
+    if (m_storage && m_storage->refCount() > 1) {
+        auto copy = m_storage->clone();
+        if (m_storage->unref()) {
+            delete m_storage;
+        }
+        m_storage = copy;
+    }
+}
+
+
+template <typename Tp>
+void RingArray<Tp>::write(const Tp *values, Index count) {
+    Tp *buffer = m_storage->begin();
+    Index first = std::min(count, m_capacity - m_head);
+    std::copy(values, values + first, buffer + m_head);
+    std::copy(values, values + first, buffer + m_head + m_capacity);
+    std::copy(values + first, values + count, buffer);
+    std::copy(values + first, values + count, buffer + m_capacity);
+    m_head = (m_head + count) % m_capacity;
+    m_size = std::min(m_size + count, m_capacity);
+}
+
+
+template <typename Tp>
+void RingArray<Tp>::push(const Tp &value) {
+    if (m_capacity == 0) {
+        return;
+    }
+    detach();
+    Tp *buffer = m_storage->begin();
+    buffer[m_head] = value;
+    buffer[m_head + m_capacity] = value;
+    m_head = (m_head + 1 == m_capacity) ? 0 : m_head + 1;
+    if (m_size < m_capacity) {
+        m_size += 1;
+    }
+    m_total += 1;
+}
+
+
+template <typename Tp>
+void RingArray<Tp>::pushN(const Tp *values, Index count) {
+    if (m_capacity == 0 || count <= 0) {
+        return;
+    }
+    detach();
+    m_total += count;
+    if (count > m_capacity) {
+        values += count - m_capacity;
+        count = m_capacity;
+    }
+    write(values, count);
+}
+
+
+template <typename Tp>
+void RingArray<Tp>::pushN(const ArrayView<Tp> &values) {
+    if (values.isContiguous()) {
+        pushN(values.data(), values.size());
+        return;
+    }
+    // Strided data goes through a small buffer
+    const Index chunk = 256;
+    Tp buffer[chunk];
+    for (Index k=0; k<values.size(); k+=chunk) {
+        Index n = std::min(chunk, values.size() - k);
+        for (Index i=0; i<n; ++i) {
+            buffer[i] = values[k+i];
+        }
+        pushN(buffer, n);
+    }
+}
+
+
+template <typename Tp>
+void RingArray<Tp>::clear() {
+    m_size = 0;
+    m_head = 0;
+    m_total = 0;
+}
+
+
+template <typename Tp>
+ArrayView<Tp> RingArray<Tp>::last(Index n) const {
+    n = std::max(Index(0), std::min(n, m_size));
+    if (!m_storage || n == 0) {
+        return ArrayView<Tp>();
+    }
+    return ArrayView<Tp>(m_storage, m_head - n + m_capacity, n);
+}
+
+
+template <typename Tp>
+Array<1,Tp> RingArray<Tp>::toArray() const {
+    Array<1,Tp> ret(m_size);
+    std::copy(data(), data() + m_size, ret.begin());
+    return ret;
+}
+
+} // namespace Ksl
+
+#endif // KSL_ARRAYRING_H
@@ -0,0 +1,297 @@
+/*
+ * Copyright (C) 2016  Elvis Teixeira
+ *
+ * This source code is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General
+ * Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This source code is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef KSL_ARRAYSORT_H
+#define KSL_ARRAYSORT_H
+
+#include <Ksl/ArrayApply.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Smallest run sorted by a single thread
+#ifndef KSL_SORT_GRAIN
+#define KSL_SORT_GRAIN 32768
+#endif
+
+namespace Ksl {
+
+enum ArraySearchSide {
+    SearchLeft,
+    SearchRight
+};
+
+
+// Elements of a taken among the first d of the
+// stable merge of a and b (the merge path split)
+template <typename Tp, typename Less>
+Index mergeSplit(const Tp *a, Index na, const Tp *b, Index nb,
+                 Index d, Less less)
+{
+    Index lo = std::max(Index(0), d - nb);
+    Index hi = std::min(d, na);
+    while (lo < hi) {
+        Index i = (lo + hi)/2;
+        if (less(b[d-1-i], a[i])) {
+            hi = i;
+        } else {
+            lo = i + 1;
+        }
+    }
+    return lo;
+}
+
+
+// Stable merge, the selects compile to conditional
+// moves instead of hard to predict branches
+template <typename Tp, typename Less>
+void mergeRuns(const Tp *a, Index na, const Tp *b, Index nb,
+               Tp *out, Less less)
+{
+    Index i = 0, j = 0;
+    while (i < na && j < nb) {
+        bool takeB = less(b[j], a[i]);
+        *out++ = takeB ? b[j] : a[i];
+        j += takeB;
+        i += !takeB;
+    }
+    out = std::copy(a + i, a + na, out);
+    std::copy(b + j, b + nb, out);
+}
+
+
+// Merge with the output split among the threads
+template <typename Tp, typename Less>
+void parallelMerge(const Tp *a, Index na, const Tp *b, Index nb,
+                   Tp *out, Less less)
+{
+    ThreadPool::global().parallelFor(na + nb, KSL_SORT_GRAIN,
+                                     [&](Index d0, Index d1) {
+        Index i0 = mergeSplit(a, na, b, nb, d0, less);
+        Index i1 = mergeSplit(a, na, b, nb, d1, less);
+        mergeRuns(a + i0, i1 - i0, b + (d0 - i0), (d1 - i1) - (d0 - i0),
+                  out + d0, less);
+    });
+}
+
+
+/*********************************************
+ * Parallel merge sort: one run per thread is
+ * sorted, then the runs are merged in pairs,
+ * each merge split among threads. The merges
+ * are stable, the whole sort is if the runs
+ * are sorted by std::stable_sort
+ *********************************************/
+template <typename Tp, typename Less>
+void parallelSort(Tp *data, Index size, Less less, bool stable) {
+    auto sortRun = [stable,less](Tp *begin, Tp *end) {
+        if (stable) {
+            std::stable_sort(begin, end, less);
+        } else {
+            std::sort(begin, end, less);
+        }
+    };
+    ThreadPool &pool = ThreadPool::global();
+    Index runs = std::min(Index(pool.threadCount()), size/KSL_SORT_GRAIN);
+    if (runs < 2) {
+        sortRun(data, data + size);
+        return;
+    }
+
+    std::vector<Index> bounds(runs + 1);
+    for (Index r=0; r<=runs; ++r) {
+        bounds[r] = size*r/runs;
+    }
+    pool.parallelFor(runs, 1, [&](Index r0, Index r1) {
+        for (Index r=r0; r<r1; ++r) {
+            sortRun(data + bounds[r], data + bounds[r+1]);
+        }
+    });
+
+    Array<1,Tp> buffer(size);
+    Tp *src = data;
+    Tp *dest = buffer.begin();
+    while (bounds.size() > 2) {
+        std::vector<Index> merged;
+        for (size_t r=0; r+1<bounds.size(); r+=2) {
+            merged.push_back(bounds[r]);
+            if (r+2 < bounds.size()) {
+                parallelMerge(src + bounds[r], bounds[r+1] - bounds[r],
+                              src + bounds[r+1], bounds[r+2] - bounds[r+1],
+                              dest + bounds[r], less);
+            } else {
+                std::copy(src + bounds[r], src + bounds[r+1], dest + bounds[r]);
+            }
+        }
+        merged.push_back(size);
+        bounds.swap(merged);
+        std::swap(src, dest);
+    }
+    if (src != data) {
+        parallelIndexes(size, KSL_PARALLEL_GRAIN, [&](Index k) {
+            data[k] = src[k];
+        });
+    }
+}
+
+
+/*********************************************
+ * Ordering of 1D arrays, the sorts run on
+ * ThreadPool::global()
+ *********************************************/
+
+template <typename Tp> inline
+void sort(Array<1,Tp> &array) {
+    parallelSort(array.begin(), array.size(), std::less<Tp>(), false);
+}
+
+
+// Indexes that sort the array, equal elements
+// keep their order
+template <typename I=int, typename Tp> inline
+Array<1,I> argsort(const ArrayView<Tp> &view) {
+    Array<1,I> ret(view.size());
+    I *idx = ret.begin();
+    for (Index k=0; k<view.size(); ++k) {
+        idx[k] = I(k);
+    }
+    const Tp *data = view.data();
+    Index stride = view.stride();
+    parallelSort(idx, view.size(), [data,stride](I a, I b) {
+        return data[a*stride] < data[b*stride];
+    }, true);
+    return ret;
+}
+
+template <typename I=int, typename Tp> inline
+Array<1,I> argsort(const Array<1,Tp> &array) {
+    return argsort<I>(ArrayView<Tp>(array));
+}
+
+
+// Puts the element that would be at n in a sorted
+// array at n, smaller ones before and larger after
+template <typename Tp> inline
+void nth_element(Array<1,Tp> &array, Index n) {
+    Tp *data = array.begin();
+    std::nth_element(data, data + n, data + array.size());
+}
+
+
+// Quantile q in [0,1], interpolated between the
+// two closest elements, as numpy does
+template <typename Tp> inline
+double quantile(Array<1,Tp> values, double q) {
+    Index size = values.size();
+    if (size == 0) {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+    double pos = std::min(std::max(q, 0.0), 1.0) * double(size - 1);
+    Index lo = Index(pos);
+    Tp *data = values.begin();
+    std::nth_element(data, data + lo, data + size);
+    double ret = double(data[lo]);
+    if (lo + 1 < size && pos > double(lo)) {
+        double next = double(*std::min_element(data + lo + 1, data + size));
+        ret += (pos - double(lo))*(next - ret);
+    }
+    return ret;
+}
+
+template <typename Tp> inline
+double quantile(const ArrayView<Tp> &view, double q) {
+    return quantile(copy(view), q);
+}
+
+
+// Percentile p in [0,100]
+template <typename A> inline
+double percentile(const A &values, double p) {
+    return quantile(values, p/100.0);
+}
+
+
+template <typename A> inline
+double median(const A &values) {
+    return quantile(values, 0.5);
+}
+
+
+// The distinct elements, sorted
+template <typename Tp> inline
+Array<1,Tp> unique(Array<1,Tp> values) {
+    sort(values);
+    Tp *data = values.begin();
+    Index count = std::unique(data, data + values.size()) - data;
+    Array<1,Tp> ret(count);
+    std::copy(data, data + count, ret.begin());
+    return ret;
+}
+
+template <typename Tp> inline
+Array<1,Tp> unique(const ArrayView<Tp> &view) {
+    return unique(copy(view));
+}
+
+
+// Position where value would be inserted to keep
+// the sorted array sorted: before the elements
+// equal to it for SearchLeft, after for SearchRight
+template <typename Tp> inline
+Index searchsorted(const ArrayView<Tp> &sorted, const Tp &value,
+                   ArraySearchSide side=SearchLeft)
+{
+    auto pos = (side == SearchLeft)
+        ? std::lower_bound(sorted.begin(), sorted.end(), value)
+        : std::upper_bound(sorted.begin(), sorted.end(), value);
+    return Index(pos - sorted.begin());
+}
+
+template <typename Tp> inline
+Index searchsorted(const Array<1,Tp> &sorted, const Tp &value,
+                   ArraySearchSide side=SearchLeft)
+{
+    return searchsorted(ArrayView<Tp>(sorted), value, side);
+}
+
+
+// Positions of many values, searched in parallel
+template <typename I=int, typename Tp> inline
+Array<1,I> searchsorted(const ArrayView<Tp> &sorted, const ArrayView<Tp> &values,
+                        ArraySearchSide side=SearchLeft)
+{
+    Array<1,I> ret(values.size());
+    I *dest = ret.begin();
+    parallelIndexes(values.size(), KSL_PARALLEL_GRAIN/16, [&](Index k) {
+        dest[k] = I(searchsorted(sorted, values[k], side));
+    });
+    return ret;
+}
+
+template <typename I=int, typename Tp> inline
+Array<1,I> searchsorted(const Array<1,Tp> &sorted, const Array<1,Tp> &values,
+                        ArraySearchSide side=SearchLeft)
+{
+    return searchsorted<I>(ArrayView<Tp>(sorted), ArrayView<Tp>(values), side);
+}
+
+} // namespace Ksl
+
+#endif // KSL_ARRAYSORT_H
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2016  Elvis Teixeira
+ *
+ * This source code is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General
+ * Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This source code is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef KSL_ARRAYTRANSPOSE_H
+#define KSL_ARRAYTRANSPOSE_H
+
+#include <Ksl/Global.h>
+
+namespace Ksl {
+
+/*********************************************
+ * Cache oblivious out of place transpose:
+ * dest[j*destStride + i] = src[i*srcStride + j]
+ * for a rows x cols source. The longer side is
+ * halved until the tile fits in L1, so both
+ * the reads and the strided writes stay in
+ * cache whatever its size.
+ *********************************************/
+template <typename Tp>
+void transposeKernel(const Tp *src, Index srcStride,
+                     Tp *dest, Index destStride,
+                     Index rows, Index cols)
+{
+    const Index Tile = 32;
+    if (rows <= Tile && cols <= Tile) {
+        for (Index i=0; i<rows; ++i) {
+            for (Index j=0; j<cols; ++j) {
+                dest[j*destStride + i] = src[i*srcStride + j];
+            }
+        }
+    } else if (rows >= cols) {
+        Index half = rows/2;
+        transposeKernel(src, srcStride, dest, destStride, half, cols);
+        transposeKernel(src + half*srcStride, srcStride,
+                        dest + half, destStride, rows - half, cols);
+    } else {
+        Index half = cols/2;
+        transposeKernel(src, srcStride, dest, destStride, rows, half);
+        transposeKernel(src + half, srcStride,
+                        dest + half*destStride, destStride, rows, cols - half);
+    }
+}
+
+} // namespace Ksl
+
+#endif // KSL_ARRAYTRANSPOSE_H
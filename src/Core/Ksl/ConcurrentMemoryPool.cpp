@@ -0,0 +1,471 @@
+/*
+ * Copyright (C) 2016  Elvis Teixeira
+ *
+ * This source code is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General
+ * Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This source code is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <Ksl/ConcurrentMemoryPool_p.h>
+#include <algorithm>
+
+namespace Ksl {
+
+namespace {
+
+// Pools are told apart by id, addresses are reused
+std::atomic<uint64_t> nextPoolId(1);
+
+
+struct LocalCacheRef
+{
+    uint64_t poolId;
+    std::weak_ptr<ConcurrentPoolCore> core;
+    PoolThreadCache *cache;
+};
+
+
+// Caches used by this thread, given back to the
+// pools that are still alive when it finishes
+struct LocalCaches
+{
+    ~LocalCaches() {
+        for (auto &ref : refs) {
+            if (auto core = ref.core.lock())
+                core->releaseCache(ref.cache);
+        }
+    }
+
+    std::vector<LocalCacheRef> refs;
+    uint64_t lastPoolId = 0;
+    PoolThreadCache *lastCache = nullptr;
+};
+
+thread_local LocalCaches localCaches;
+
+
+// Only the owner thread writes the counters of a cache
+void countEvent(std::atomic<uint64_t> &counter) {
+    counter.store(counter.load(std::memory_order_relaxed) + 1,
+                  std::memory_order_relaxed);
+}
+
+
+uint64_t stackHead(uint64_t head, uint32_t top) {
+    return (((head >> 32) + 1) << 32) | top;
+}
+
+} // namespace
+
+
+ConcurrentMemoryPool::ConcurrentMemoryPool(uint64_t unitSize)
+    : Ksl::Object(new ConcurrentMemoryPoolPrivate(this, unitSize))
+{ }
+
+
+uint64_t ConcurrentMemoryPool::unitSize() const {
+    KSL_PUBLIC(const ConcurrentMemoryPool);
+    return m->core->unitSize;
+}
+
+
+ConcurrentMemoryPool::Stats ConcurrentMemoryPool::stats() const {
+    KSL_PUBLIC(const ConcurrentMemoryPool);
+    ConcurrentPoolCore *core = m->core.get();
+    Stats ret;
+    ret.allocations = 0;
+    ret.releases = 0;
+    for (auto cache = core->caches.load(std::memory_order_acquire);
+         cache; cache = cache->nextCache)
+    {
+        ret.allocations += cache->allocations.load(std::memory_order_relaxed);
+        ret.releases += cache->releases.load(std::memory_order_relaxed);
+    }
+    ret.unitBytes = core->unitBytes.load(std::memory_order_relaxed);
+    ret.threadCaches = core->cacheCount.load(std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(core->largeMutex);
+    ret.largeBytes = core->largeBytes;
+    return ret;
+}
+
+
+void* ConcurrentMemoryPool::allocBytes(uint64_t amount, uint64_t alignment) {
+    KSL_PUBLIC(ConcurrentMemoryPool);
+    if (alignment > MemoryPoolPrivate::Granule) {
+        void *block = allocBytes(amount + alignment);
+        return block ? MemoryPoolPrivate::alignBlock(block, alignment) : nullptr;
+    }
+    ConcurrentPoolCore *core = m->core.get();
+    PoolThreadCache *cache = m->localCache();
+    uint64_t size;
+    int index = MemoryPoolPrivate::sizeClass(amount, size);
+    void *block = (size > core->unitSize)
+        ? core->allocLarge(amount)
+        : core->alloc(cache, index, size);
+    if (block)
+        countEvent(cache->allocations);
+    return block;
+}
+
+
+void ConcurrentMemoryPool::freeBytes(void *location, uint64_t size,
+                                     uint64_t alignment)
+{
+    KSL_PUBLIC(ConcurrentMemoryPool);
+    if (!location)
+        return;
+    if (alignment > MemoryPoolPrivate::Granule) {
+        freeBytes(MemoryPoolPrivate::blockStart(location), size + alignment);
+        return;
+    }
+    ConcurrentPoolCore *core = m->core.get();
+    PoolThreadCache *cache = m->localCache();
+    uint64_t classSize;
+    int index = MemoryPoolPrivate::sizeClass(size, classSize);
+    if (classSize > core->unitSize)
+        core->freeLarge(location);
+    else
+        core->free(cache, index, location);
+    countEvent(cache->releases);
+}
+
+
+PoolThreadCache* ConcurrentMemoryPoolPrivate::localCache() {
+    LocalCaches &local = localCaches;
+    if (local.lastPoolId == core->id)
+        return local.lastCache;
+
+    PoolThreadCache *cache = nullptr;
+    for (auto &ref : local.refs) {
+        if (ref.poolId == core->id) {
+            cache = ref.cache;
+            break;
+        }
+    }
+    if (!cache) {
+        // forget the pools that are gone
+        auto dead = std::remove_if(local.refs.begin(), local.refs.end(),
+            [](const LocalCacheRef &ref) { return ref.core.expired(); });
+        local.refs.erase(dead, local.refs.end());
+
+        cache = core->adoptCache();
+        LocalCacheRef ref = { core->id, core, cache };
+        local.refs.push_back(ref);
+    }
+    local.lastPoolId = core->id;
+    local.lastCache = cache;
+    return cache;
+}
+
+
+ConcurrentPoolCore::ConcurrentPoolCore(uint64_t unitSize)
+    : id(nextPoolId.fetch_add(1))
+    , emptyStack(0)
+    , magazineCount(0)
+    , units(nullptr)
+    , unitBytes(0)
+    , trackedUnits(0)
+    , caches(nullptr)
+    , cacheCount(0)
+    , largeBlocks(nullptr)
+    , largeBytes(0)
+{
+    const uint64_t granule = MemoryPoolPrivate::Granule;
+    if (unitSize < granule)
+        unitSize = granule;
+    this->unitSize = (unitSize + granule - 1) / granule * granule;
+
+    uint64_t classSize;
+    classCount = MemoryPoolPrivate::sizeClass(this->unitSize, classSize) + 1;
+    fullStacks.reset(new std::atomic<uint64_t>[classCount]);
+    for (int k=0; k<classCount; ++k)
+        fullStacks[k].store(0, std::memory_order_relaxed);
+    for (int k=0; k<MaxChunks; ++k)
+        chunks[k].store(nullptr, std::memory_order_relaxed);
+}
+
+
+ConcurrentPoolCore::~ConcurrentPoolCore() {
+    PoolThreadCache *cache = caches.load();
+    while (cache) {
+        PoolThreadCache *next = cache->nextCache;
+        delete cache;
+        cache = next;
+    }
+    for (int k=0; k<MaxChunks; ++k)
+        delete[] chunks[k].load();
+    char *unit = units.load();
+    while (unit) {
+        char *next = *reinterpret_cast<char**>(unit);
+        delete[] unit;
+        unit = next;
+    }
+    for (uint32_t k=0; k<trackedUnits.load(); ++k)
+        MemoryStats::released(MemoryStats::PoolUnits, qint64(unitSize));
+    while (largeBlocks)
+        freeLarge(largeBlocks + 1);
+}
+
+
+// Takes the cache of a finished thread or makes a new one
+PoolThreadCache* ConcurrentPoolCore::adoptCache() {
+    for (auto cache = caches.load(std::memory_order_acquire);
+         cache; cache = cache->nextCache)
+    {
+        bool used = false;
+        if (!cache->inUse.load(std::memory_order_relaxed) &&
+            cache->inUse.compare_exchange_strong(
+                used, true, std::memory_order_acquire))
+        {
+            return cache;
+        }
+    }
+
+    auto cache = new PoolThreadCache(classCount);
+    PoolThreadCache *head = caches.load(std::memory_order_relaxed);
+    do {
+        cache->nextCache = head;
+    } while (!caches.compare_exchange_weak(
+                 head, cache, std::memory_order_release,
+                 std::memory_order_relaxed));
+    cacheCount.fetch_add(1, std::memory_order_relaxed);
+    return cache;
+}
+
+
+// Moves the blocks of a finished thread to the depot
+void ConcurrentPoolCore::releaseCache(PoolThreadCache *cache) {
+    recycleTail(cache);
+    cache->pos = nullptr;
+    cache->end = nullptr;
+
+    for (int k=0; k<classCount; ++k) {
+        PoolMagazine *magazines[2] = { cache->loaded[k], cache->previous[k] };
+        for (auto magazine : magazines) {
+            if (magazine)
+                push(magazine->count ? fullStacks[k] : emptyStack, magazine);
+        }
+        cache->loaded[k] = nullptr;
+        cache->previous[k] = nullptr;
+    }
+    cache->inUse.store(false, std::memory_order_release);
+}
+
+
+void* ConcurrentPoolCore::alloc(PoolThreadCache *cache, int index, uint64_t size) {
+    PoolMagazine *&loaded = cache->loaded[index];
+    if (loaded && loaded->count > 0)
+        return loaded->blocks[--loaded->count];
+
+    PoolMagazine *&previous = cache->previous[index];
+    if (previous && previous->count > 0) {
+        std::swap(loaded, previous);
+        return loaded->blocks[--loaded->count];
+    }
+
+    // Both are empty, trade one for a full magazine
+    PoolMagazine *full = pop(fullStacks[index]);
+    if (full) {
+        if (loaded)
+            push(emptyStack, loaded);
+        loaded = full;
+        return loaded->blocks[--loaded->count];
+    }
+
+    // Or carve a new block
+    if (uint64_t(cache->end - cache->pos) < size && !addUnit(cache))
+        return nullptr;
+    void *block = cache->pos;
+    cache->pos += size;
+    return block;
+}
+
+
+void ConcurrentPoolCore::free(PoolThreadCache *cache, int index, void *block) {
+    PoolMagazine *&loaded = cache->loaded[index];
+    if (loaded && loaded->count < PoolMagazine::Capacity) {
+        loaded->blocks[loaded->count++] = block;
+        return;
+    }
+
+    PoolMagazine *&previous = cache->previous[index];
+    if (previous && previous->count < PoolMagazine::Capacity) {
+        std::swap(loaded, previous);
+        loaded->blocks[loaded->count++] = block;
+        return;
+    }
+
+    // Both are full, give one to the depot
+    if (previous)
+        push(fullStacks[index], previous);
+    previous = loaded;
+    loaded = pop(emptyStack);
+    if (!loaded)
+        loaded = newMagazine();
+    loaded->blocks[loaded->count++] = block;
+}
+
+
+PoolMagazine* ConcurrentPoolCore::magazineAt(uint32_t index) const {
+    uint32_t chunk = 0;
+    uint32_t first = 0;
+    while (index >= first + (ChunkBase << chunk)) {
+        first += ChunkBase << chunk;
+        chunk += 1;
+    }
+    return chunks[chunk].load(std::memory_order_acquire) + (index - first);
+}
+
+
+PoolMagazine* ConcurrentPoolCore::newMagazine() {
+    uint32_t index = magazineCount.fetch_add(1, std::memory_order_relaxed);
+    uint32_t chunk = 0;
+    uint32_t first = 0;
+    while (index >= first + (ChunkBase << chunk)) {
+        first += ChunkBase << chunk;
+        chunk += 1;
+    }
+    if (int(chunk) >= MaxChunks)
+        throw std::bad_alloc();
+
+    PoolMagazine *magazines = chunks[chunk].load(std::memory_order_acquire);
+    if (!magazines) {
+        auto fresh = new PoolMagazine[ChunkBase << chunk];
+        if (chunks[chunk].compare_exchange_strong(
+                magazines, fresh, std::memory_order_acq_rel))
+        {
+            magazines = fresh;
+        } else {
+            delete[] fresh;
+        }
+    }
+    PoolMagazine *magazine = magazines + (index - first);
+    magazine->index = index;
+    magazine->count = 0;
+    return magazine;
+}
+
+
+PoolMagazine* ConcurrentPoolCore::pop(std::atomic<uint64_t> &stack) {
+    uint64_t head = stack.load(std::memory_order_acquire);
+    while (uint32_t(head) != 0) {
+        PoolMagazine *magazine = magazineAt(uint32_t(head) - 1);
+        uint32_t next = magazine->next.load(std::memory_order_relaxed);
+        if (stack.compare_exchange_weak(head, stackHead(head, next),
+                                        std::memory_order_acquire,
+                                        std::memory_order_acquire))
+        {
+            return magazine;
+        }
+    }
+    return nullptr;
+}
+
+
+void ConcurrentPoolCore::push(std::atomic<uint64_t> &stack,
+                              PoolMagazine *magazine)
+{
+    uint64_t head = stack.load(std::memory_order_relaxed);
+    do {
+        magazine->next.store(uint32_t(head), std::memory_order_relaxed);
+    } while (!stack.compare_exchange_weak(
+                 head, stackHead(head, magazine->index + 1),
+                 std::memory_order_release, std::memory_order_relaxed));
+}
+
+
+// Gives the thread a new unit
+bool ConcurrentPoolCore::addUnit(PoolThreadCache *cache) {
+    const uint64_t granule = MemoryPoolPrivate::Granule;
+    char *unit = new (std::nothrow) char[unitSize + granule];
+    if (!unit)
+        return false;
+
+    char *head = units.load(std::memory_order_relaxed);
+    do {
+        *reinterpret_cast<char**>(unit) = head;
+    } while (!units.compare_exchange_weak(
+                 head, unit, std::memory_order_release,
+                 std::memory_order_relaxed));
+    unitBytes.fetch_add(unitSize + granule, std::memory_order_relaxed);
+    if (MemoryStats::isEnabled()) {
+        MemoryStats::allocated(MemoryStats::PoolUnits, qint64(unitSize));
+        trackedUnits.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    recycleTail(cache);
+    cache->pos = unit + granule;
+    cache->end = cache->pos + unitSize;
+    return true;
+}
+
+
+// Splits the rest of the thread's unit into free blocks
+void ConcurrentPoolCore::recycleTail(PoolThreadCache *cache) {
+    while (cache->end - cache->pos >= int(MemoryPoolPrivate::Granule)) {
+        uint64_t size = uint64_t(cache->end - cache->pos);
+        uint64_t classSize;
+        int index = MemoryPoolPrivate::sizeClass(size, classSize);
+        if (classSize > size) {
+            index -= 1;
+            classSize = MemoryPoolPrivate::classSizeAt(index);
+        }
+        free(cache, index, cache->pos);
+        cache->pos += classSize;
+    }
+}
+
+
+void* ConcurrentPoolCore::allocLarge(uint64_t amount) {
+    void *raw = ::operator new(sizeof(MemoryPoolLargeBlock) + amount,
+                               std::nothrow);
+    if (!raw)
+        return nullptr;
+    auto block = static_cast<MemoryPoolLargeBlock*>(raw);
+    block->prev = nullptr;
+    block->size = amount;
+    block->tracked = MemoryStats::isEnabled();
+    {
+        std::lock_guard<std::mutex> lock(largeMutex);
+        block->next = largeBlocks;
+        if (largeBlocks)
+            largeBlocks->prev = block;
+        largeBlocks = block;
+        largeBytes += amount;
+    }
+    if (block->tracked)
+        MemoryStats::allocated(MemoryStats::PoolUnits, qint64(amount));
+    return block + 1;
+}
+
+
+void ConcurrentPoolCore::freeLarge(void *location) {
+    auto block = static_cast<MemoryPoolLargeBlock*>(location) - 1;
+    {
+        std::lock_guard<std::mutex> lock(largeMutex);
+        if (block->prev)
+            block->prev->next = block->next;
+        else
+            largeBlocks = block->next;
+        if (block->next)
+            block->next->prev = block->prev;
+        largeBytes -= block->size;
+    }
+    if (block->tracked)
+        MemoryStats::released(MemoryStats::PoolUnits, qint64(block->size));
+    ::operator delete(block);
+}
+
+} // namespace Ksl
@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2016  Elvis Teixeira
+ *
+ * This source code is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General
+ * Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This source code is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef KSL_CONCURRENTMEMORYPOOL_H
+#define KSL_CONCURRENTMEMORYPOOL_H
+
+#include <Ksl/Object.h>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+namespace Ksl {
+
+/*********************************************
+ * MemoryPool that many threads may use at once.
+ * Every thread has a cache holding a few blocks
+ * of each size class, so most allocations and
+ * frees touch no shared state. Caches swap full
+ * and empty magazines of blocks with a shared
+ * lock-free depot, so blocks freed by one
+ * thread are reused by the others. Blocks that
+ * don't fit in a unit come from the heap under
+ * a lock. As with MemoryPool, freeBytes() must
+ * get the size and alignment given to
+ * allocBytes(), and the pool must outlive the
+ * threads' use of it. Destructors are run by
+ * free() only, there is no registry.
+ *********************************************/
+class KSL_EXPORT ConcurrentMemoryPool
+    : public Ksl::Object
+{
+public:
+
+    // Counters summed over all the threads
+    struct Stats {
+        uint64_t allocations;
+        uint64_t releases;
+        // Bytes of the units taken from the system
+        uint64_t unitBytes;
+        // Bytes of the live blocks from the heap
+        uint64_t largeBytes;
+        // Thread caches created so far
+        uint32_t threadCaches;
+    };
+
+
+    ConcurrentMemoryPool(uint64_t unitSize=65536);
+
+    uint64_t unitSize() const;
+
+    Stats stats() const;
+
+
+    void* allocBytes(uint64_t amount, uint64_t alignment=16);
+
+    void freeBytes(void *location, uint64_t size, uint64_t alignment=16);
+
+
+    template <typename T, typename... Args>
+    inline T* alloc(Args&&... args) {
+        void *ptr = allocBytes(sizeof(T), alignof(T));
+        if (!ptr)
+            return nullptr;
+        try {
+            return new (ptr) T(std::forward<Args>(args)...);
+        } catch (...) {
+            freeBytes(ptr, sizeof(T), alignof(T));
+            throw;
+        }
+    }
+
+    template <typename T>
+    inline T* allocArray(uint64_t size, uint64_t alignment=alignof(T)) {
+        return (T*) allocBytes(size*sizeof(T),
+                               alignment > alignof(T) ? alignment : alignof(T));
+    }
+
+    template <typename T>
+    inline void free(T *ptr) {
+        if (!ptr)
+            return;
+        ptr->~T();
+        freeBytes(ptr, sizeof(T), alignof(T));
+    }
+
+    template <typename T>
+    inline void freeArray(T *ptr, uint64_t size, uint64_t alignment=alignof(T)) {
+        freeBytes(ptr, size*sizeof(T),
+                  alignment > alignof(T) ? alignment : alignof(T));
+    }
+};
+
+} // namespace Ksl
+
+#endif // KSL_CONCURRENTMEMORYPOOL_H
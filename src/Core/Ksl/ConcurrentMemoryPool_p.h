@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2016  Elvis Teixeira
+ *
+ * This source code is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General
+ * Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This source code is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the public Ksl API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed. Do not include it
+//
+// We mean it.
+//
+
+#ifndef KSL_CONCURRENTMEMORYPOOL_P_H
+#define KSL_CONCURRENTMEMORYPOOL_P_H
+
+#include <Ksl/ConcurrentMemoryPool.h>
+#include <Ksl/MemoryPool_p.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Ksl {
+
+// Stack of free blocks of one size class, moved as
+// a whole between the thread caches and the depot
+struct PoolMagazine
+{
+    static const uint32_t Capacity = 32;
+
+    PoolMagazine()
+        : next(0), index(0), count(0)
+    { }
+
+    // Depot link, read by threads racing to pop it
+    std::atomic<uint32_t> next;
+    uint32_t index;
+    uint32_t count;
+    void *blocks[Capacity];
+};
+
+
+// Blocks of a thread, two magazines per class
+// and the unit it carves new blocks from
+struct PoolThreadCache
+{
+    PoolThreadCache(int classCount)
+        : inUse(true), nextCache(nullptr)
+        , loaded(classCount, nullptr)
+        , previous(classCount, nullptr)
+        , pos(nullptr), end(nullptr)
+        , allocations(0), releases(0)
+    { }
+
+    std::atomic<bool> inUse;
+    PoolThreadCache *nextCache;
+    std::vector<PoolMagazine*> loaded;
+    std::vector<PoolMagazine*> previous;
+    char *pos;
+    char *end;
+    // Written by the owner thread only
+    std::atomic<uint64_t> allocations;
+    std::atomic<uint64_t> releases;
+};
+
+
+// State shared by the pool and the caches of the
+// threads, that flush into it when they finish
+class ConcurrentPoolCore
+{
+public:
+
+    // Magazines live in chunks of ChunkBase<<k
+    // elements, so they never move
+    static const uint32_t ChunkBase = 64;
+    static const int MaxChunks = 25;
+
+    ConcurrentPoolCore(uint64_t unitSize);
+
+    ~ConcurrentPoolCore();
+
+    PoolThreadCache* adoptCache();
+
+    void releaseCache(PoolThreadCache *cache);
+
+    void* alloc(PoolThreadCache *cache, int index, uint64_t size);
+
+    void free(PoolThreadCache *cache, int index, void *block);
+
+    void* allocLarge(uint64_t amount);
+
+    void freeLarge(void *location);
+
+
+    const uint64_t id;
+    uint64_t unitSize;
+    int classCount;
+
+    // Lock-free stacks of magazines. The head keeps
+    // the index+1 of the top magazine in the low
+    // 32 bits and a counter against ABA in the high
+    std::unique_ptr<std::atomic<uint64_t>[]> fullStacks;
+    std::atomic<uint64_t> emptyStack;
+
+    std::atomic<PoolMagazine*> chunks[MaxChunks];
+    std::atomic<uint32_t> magazineCount;
+
+    // Units start with a link to the previous one
+    std::atomic<char*> units;
+    std::atomic<uint64_t> unitBytes;
+    std::atomic<uint32_t> trackedUnits;
+
+    std::atomic<PoolThreadCache*> caches;
+    std::atomic<uint32_t> cacheCount;
+
+    std::mutex largeMutex;
+    MemoryPoolLargeBlock *largeBlocks;
+    uint64_t largeBytes;
+
+
+private:
+
+    PoolMagazine* magazineAt(uint32_t index) const;
+
+    PoolMagazine* newMagazine();
+
+    PoolMagazine* pop(std::atomic<uint64_t> &stack);
+
+    void push(std::atomic<uint64_t> &stack, PoolMagazine *magazine);
+
+    void recycleTail(PoolThreadCache *cache);
+
+    bool addUnit(PoolThreadCache *cache);
+};
+
+
+class ConcurrentMemoryPoolPrivate
+    : public Ksl::ObjectPrivate
+{
+public:
+
+    ConcurrentMemoryPoolPrivate(ConcurrentMemoryPool *publ, uint64_t unitSize)
+        : Ksl::ObjectPrivate(publ)
+        , core(std::make_shared<ConcurrentPoolCore>(unitSize))
+    { }
+
+    // Cache of the calling thread
+    PoolThreadCache* localCache();
+
+    std::shared_ptr<ConcurrentPoolCore> core;
+};
+
+} // namespace Ksl
+
+#endif // KSL_CONCURRENTMEMORYPOOL_P_H
@@ -91,17 +91,48 @@ bool Csv::readAll(const QString &filePath,
         }
     }
     m->empty = false;
+    m->trackMemory();
     return true;
 }
 
 
+CsvPrivate::~CsvPrivate() {
+    if (trackedBytes > 0) {
+        MemoryStats::released(MemoryStats::CsvData, trackedBytes);
+    }
+}
+
+
+// Charges the cells to MemoryStats, with an estimate
+// of the Qt string and vector overheads
+void CsvPrivate::trackMemory() {
+    if (trackedBytes > 0) {
+        MemoryStats::released(MemoryStats::CsvData, trackedBytes);
+        trackedBytes = 0;
+    }
+    if (!MemoryStats::isEnabled()) {
+        return;
+    }
+    const qint64 dataHeader = 2*sizeof(void*) + 8;
+    qint64 bytes = 0;
+    for (auto &column : columns) {
+        bytes += dataHeader + column.capacity()*qint64(sizeof(QString));
+        for (auto &cell : column) {
+            bytes += dataHeader + (cell.capacity() + 1)*qint64(sizeof(QChar));
+        }
+    }
+    trackedBytes = bytes;
+    MemoryStats::allocated(MemoryStats::CsvData, trackedBytes);
+}
+
+
 bool Csv::empty() const {
     KSL_PUBLIC(const Csv);
     return m->empty;
 }
 
 
-int Csv::rows() const {
+Index Csv::rows() const {
     KSL_PUBLIC(const Csv);
     if (m->columns.isEmpty())
         return 0;
@@ -135,10 +166,11 @@ Array<1> Csv::array(const QString &key) const {
         return Array<1>();
 
     Array<1> ret(column.size());
-    for (int k=0; k<column.size(); ++k)
-        ret[k] = column[k].trimmed().toDouble();
+    double *dest = ret.begin();
+    for (Index k=0; k<column.size(); ++k)
+        dest[k] = column[k].trimmed().toDouble();
 
-    return std::move(ret);
+    return ret;
 }
 
 
@@ -148,33 +180,33 @@ Array<1> Csv::array(int index) const {
 }
 
 
-Array<2> Csv::matrix() const {
-    KSL_PUBLIC(const Csv);
-    Array<2> mat(rows(), cols());
-    int i=0;
-    for (auto &column : m->columns) {
-        for (int j=0; j<column.size(); ++j)
-            mat[j][i] = column[j].trimmed().toDouble();
-        ++i;
-    }
-    return std::move(mat);
+// The columns are parsed into a column major matrix, so
+// the stores are sequential, and transposed in blocks
+// if a row major one was asked for
+Array<2> Csv::matrix(ArrayLayout layout) const {
+    return matrix(0, 0, rows(), cols(), layout);
 }
 
-Array<2> Csv::matrix(int i, int j, int rows, int cols) const {
+Array<2> Csv::matrix(Index i, int j, Index rows, int cols,
+                     ArrayLayout layout) const
+{
     KSL_PUBLIC(const Csv);
-    Array<2> mat(rows, cols);
+    Array<2> mat(rows, cols, ColumnMajor);
+    if (mat.size() == 0)
+        return mat;
 
     auto coliter = m->columns.begin();
     for (int k=0; k<j; ++k)
         ++coliter;
 
     for (int k=0; k<cols; ++k) {
-        for (int l=i; l<rows; ++l) {
-            mat[l-i][k] = (*coliter)[l].trimmed().toDouble();
+        double *column = mat[k];
+        for (Index l=i; l<i+rows; ++l) {
+            column[l-i] = (*coliter)[l].trimmed().toDouble();
         }
         ++coliter;
     }
-    return std::move(mat);
+    return toLayout(mat, layout);
 }
 
 
@@ -182,8 +214,10 @@ void Csv::fillcol(Array<2> &a, int j, const QString &key) const {
     auto column = this->column(key);
     if (column.isEmpty())
         return;
-    for (int k=0; k<column.size(); ++k)
-        a[k][j] = column[k].trimmed().toDouble();
+    double *dest = a.begin() + (a.layout() == RowMajor ? j : j*a.rows());
+    Index stride = (a.layout() == RowMajor) ? a.cols() : 1;
+    for (Index k=0; k<column.size(); ++k)
+        dest[k*stride] = column[k].trimmed().toDouble();
 }
 
 
@@ -191,8 +225,10 @@ void Csv::fillcol(Array<2> &a, int j, int col) const {
     auto column = this->column(col);
     if (column.isEmpty())
         return;
-    for (int k=0; k<column.size(); ++k)
-        a[k][j] = column[k].trimmed().toDouble();
+    double *dest = a.begin() + (a.layout() == RowMajor ? j : j*a.rows());
+    Index stride = (a.layout() == RowMajor) ? a.cols() : 1;
+    for (Index k=0; k<column.size(); ++k)
+        dest[k*stride] = column[k].trimmed().toDouble();
 }
 
 } // namespace Ksl
@@ -43,7 +43,7 @@ public:
                          bool hasHeader=true, char delimiter=' ');
 
 
-    int rows() const;
+    Index rows() const;
 
     int cols() const;
 
@@ -57,9 +57,10 @@ public:
 
     Array<1> array(int index) const;
 
-    Array<2> matrix() const;
+    Array<2> matrix(ArrayLayout layout=RowMajor) const;
 
-    Array<2> matrix(int i, int j, int rows, int cols) const;
+    Array<2> matrix(Index i, int j, Index rows, int cols,
+                    ArrayLayout layout=RowMajor) const;
 
     void fillcol(Array<2> &a, int j, const QString &key) const;
 
@@ -33,6 +33,7 @@
 #define QSL_CSV_P_H
 
 #include <Ksl/Csv.h>
+#include <Ksl/MemoryStats.h>
 
 namespace Ksl {
 
@@ -44,12 +45,19 @@ public:
     CsvPrivate(Csv *publ)
         : Ksl::ObjectPrivate(publ)
         , empty(true)
+        , trackedBytes(0)
     { }
 
+    ~CsvPrivate();
+
+    void trackMemory();
+
     bool empty;
     QString filePath;
     QStringList keys;
     QList< QVector<QString> > columns;
+    // Estimate of the column bytes counted by MemoryStats
+    qint64 trackedBytes;
 };
 
 } // namespace Ksl
@@ -28,7 +28,7 @@ namespace Ksl {
 inline double poly(const Array<1> &a, double x) {
     double f = 0.0;
     double xn = 1.0;
-    for (int k=0; k<a.size(); ++k) {
+    for (Index k=0; k<a.size(); ++k) {
         f += a[k] * xn;
         xn *= x;
     }
@@ -23,6 +23,7 @@
 
 #include <QObject>
 #include <QTextStream>
+#include <cstddef>
 
 #define KSL_BEGIN_NAMESPACE namespace Ksl {
 #define KSL_END_NAMESPACE } // namespace Ksl
@@ -33,6 +34,14 @@
 
 #define KSL_EXPORT
 
+namespace Ksl {
+
+// Type of array sizes and indexes, wide enough
+// for arrays with more than 2^31 elements
+typedef std::ptrdiff_t Index;
+
+} // namespace Ksl
+
 extern QTextStream qin;
 extern QTextStream qout;
 extern QTextStream qerr;
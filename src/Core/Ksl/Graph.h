@@ -22,6 +22,7 @@
 #define KSL_GRAPH_H
 
 #include <Ksl/MemoryPool.h>
+#include <vector>
 
 namespace Ksl {
 
@@ -29,6 +30,7 @@ namespace Ksl {
 template <typename VertData, typename EdgeData> class GraphEdge;
 template <typename VertData, typename EdgeData> class GraphVertex;
 template <typename VertData, typename EdgeData> class Graph;
+template <typename VertData, typename EdgeData> class CsrGraph;
 
 
 
@@ -143,6 +145,8 @@ public:
     Graph(MemoryPool *vertPool, MemoryPool *edgePool, const VertData &entryData)
         : m_vertPool(vertPool)
         , m_edgePool(edgePool)
+        , m_vertexCount(1)
+        , m_edgeCount(0)
     {
         m_entry = vertPool->alloc<TVertex>(entryData);
     }
@@ -156,6 +160,16 @@ public:
         // prepend to edge list
         edge->m_next = vertex->m_edges;
         vertex->m_edges = edge;
+        m_vertexCount += 1;
+        m_edgeCount += 1;
+    }
+
+    Index vertexCount() const { return m_vertexCount; }
+    Index edgeCount() const { return m_edgeCount; }
+
+    // Compact snapshot for fast traversal, see CsrGraph
+    CsrGraph<VertData,EdgeData> freeze() const {
+        return CsrGraph<VertData,EdgeData>(*this);
     }
 
 
@@ -165,6 +179,106 @@ private:
     MemoryPool *m_vertPool;
     MemoryPool *m_edgePool;
     TVertex *m_entry;
+    Index m_vertexCount;
+    Index m_edgeCount;
+};
+
+
+// Compressed sparse row snapshot of a Graph. Vertices
+// are numbered in breadth first order from the entry,
+// which is vertex 0, and the edges leaving vertex v are
+// edgeBegin(v) to edgeEnd(v), in the order of the
+// vertex edge list. Targets and data live in plain
+// arrays, so a traversal streams through memory instead
+// of chasing one pointer per edge. The snapshot does not
+// follow later changes to the graph, call freeze() again
+template <
+    typename VertData,
+    typename EdgeData=VertData
+>
+class CsrGraph
+{
+public:
+
+    typedef GraphEdge<VertData,EdgeData> TEdge;
+    typedef GraphVertex<VertData,EdgeData> TVertex;
+    typedef Graph<VertData,EdgeData> TGraph;
+
+    CsrGraph() { }
+
+    explicit CsrGraph(const TGraph &graph) {
+        m_vertices.reserve(graph.vertexCount());
+        m_vertData.reserve(graph.vertexCount());
+        m_offsets.reserve(graph.vertexCount() + 1);
+        m_targets.reserve(graph.edgeCount());
+        m_edgeData.reserve(graph.edgeCount());
+
+        // The queue of the search is the vertex array itself.
+        // addNeighbor() always creates the target, so each
+        // vertex is reached by one edge and gets the next index
+        m_vertices.push_back(const_cast<TVertex*>(graph.entry()));
+        m_offsets.push_back(0);
+        for (std::size_t k=0; k<m_vertices.size(); ++k) {
+            const TVertex *vertex = m_vertices[k];
+            m_vertData.push_back(vertex->data());
+            for (auto edge = vertex->firstEdge(); edge != nullptr; edge = edge->next()) {
+                m_targets.push_back(Index(m_vertices.size()));
+                m_vertices.push_back(const_cast<TVertex*>(edge->target()));
+                m_edgeData.push_back(edge->data());
+            }
+            m_offsets.push_back(Index(m_targets.size()));
+        }
+    }
+
+    Index vertexCount() const { return Index(m_vertices.size()); }
+    Index edgeCount() const { return Index(m_targets.size()); }
+
+    Index edgeBegin(Index vertex) const { return m_offsets[vertex]; }
+    Index edgeEnd(Index vertex) const { return m_offsets[vertex+1]; }
+    Index degree(Index vertex) const { return m_offsets[vertex+1] - m_offsets[vertex]; }
+
+    Index target(Index edge) const { return m_targets[edge]; }
+
+    VertData& vertexData(Index vertex) { return m_vertData[vertex]; }
+    const VertData& vertexData(Index vertex) const { return m_vertData[vertex]; }
+
+    EdgeData& edgeData(Index edge) { return m_edgeData[edge]; }
+    const EdgeData& edgeData(Index edge) const { return m_edgeData[edge]; }
+
+    // The graph vertex a snapshot vertex came from
+    TVertex* vertex(Index vertex) const { return m_vertices[vertex]; }
+
+    // Raw arrays, for loops that want them directly
+    const Index* offsets() const { return m_offsets.data(); }
+    const Index* targets() const { return m_targets.data(); }
+    const VertData* vertexData() const { return m_vertData.data(); }
+    const EdgeData* edgeData() const { return m_edgeData.data(); }
+
+
+    Index findNeighbor(Index vertex, const VertData &neighborData) const {
+        for (Index e=edgeBegin(vertex); e<edgeEnd(vertex); ++e) {
+            if (m_vertData[m_targets[e]] == neighborData)
+                return m_targets[e];
+        }
+        return -1;
+    }
+
+    Index findNeighborByEdge(Index vertex, const EdgeData &edgeData) const {
+        for (Index e=edgeBegin(vertex); e<edgeEnd(vertex); ++e) {
+            if (m_edgeData[e] == edgeData)
+                return m_targets[e];
+        }
+        return -1;
+    }
+
+
+private:
+
+    std::vector<Index> m_offsets;
+    std::vector<Index> m_targets;
+    std::vector<VertData> m_vertData;
+    std::vector<EdgeData> m_edgeData;
+    std::vector<TVertex*> m_vertices;
 };
 
 
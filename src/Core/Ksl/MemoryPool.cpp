@@ -19,6 +19,8 @@
  */
 
 #include <Ksl/MemoryPool_p.h>
+#include <algorithm>
+#include <new>
 
 KSL_BEGIN_NAMESPACE
 
@@ -26,53 +28,300 @@ MemoryPool::MemoryPool(uint64_t unitSize, uint32_t numUnits)
     : Ksl::Object(new MemoryPoolPrivate(this))
 {
     KSL_PUBLIC(MemoryPool);
-    m->unitSize = unitSize;
-    m->numUnits = numUnits;
-    m->unitsUsed = 1;
+    const uint64_t granule = MemoryPoolPrivate::Granule;
+    if (unitSize < granule)
+        unitSize = granule;
+    m->unitSize = (unitSize + granule - 1) / granule * granule;
 
-    m->units = new char*[numUnits];
-    m->units[0] = new char[unitSize];
-    m->currUnit = m->units[0];
-    m->pos = m->currUnit;
+    uint64_t classSize;
+    m->freeLists.resize(MemoryPoolPrivate::sizeClass(m->unitSize, classSize) + 1);
+    m->units.reserve(numUnits);
+    m->addUnit();
 }
 
 
-void* MemoryPool::allocBytes(uint64_t amount) {
+MemoryPoolPrivate::~MemoryPoolPrivate() {
+    destroyObjects();
+    for (auto unit : units)
+        delete[] unit;
+    for (uint32_t k=0; k<trackedUnits; ++k)
+        MemoryStats::released(MemoryStats::PoolUnits, qint64(unitSize));
+    while (largeBlocks)
+        freeLarge(largeBlocks + 1);
+}
+
+
+uint64_t MemoryPool::unitSize() const {
+    KSL_PUBLIC(const MemoryPool);
+    return m->unitSize;
+}
+
+
+uint32_t MemoryPool::unitCount() const {
+    KSL_PUBLIC(const MemoryPool);
+    return uint32_t(m->units.size());
+}
+
+
+void MemoryPool::reset() {
     KSL_PUBLIC(MemoryPool);
-    void *buffer;
+    m->destroyObjects();
+    while (m->largeBlocks)
+        m->freeLarge(m->largeBlocks + 1);
+    for (auto &head : m->freeLists)
+        head = nullptr;
+    m->markedLists.clear();
+    m->nextUnit = 0;
+    m->pos = nullptr;
+    m->end = nullptr;
+    m->addUnit();
+}
 
-    // MemoryPool can not allocate buffers bigger than unitSize
-    if (amount > m->unitSize)
-        return nullptr;
 
-    // If there is space in the current unit, just update position
-    // of pointer and return the current possition
-    uint64_t available = uint64_t(m->currUnit) + m->unitSize - uint64_t(m->pos);
-    if (available >= amount) {
-        buffer = m->pos;
-        m->pos += amount;
-        return buffer;
+// The free lists are hidden until the rollback,
+// so the blocks reused in the scope are its own
+MemoryPool::Mark MemoryPool::mark() {
+    KSL_PUBLIC(MemoryPool);
+    Mark ret;
+    ret.depth = m->markedLists.size();
+    ret.unit = m->nextUnit;
+    ret.pos = m->pos;
+    ret.end = m->end;
+    ret.serial = m->serial;
+    m->markedLists.insert(m->markedLists.end(),
+                          m->freeLists.begin(), m->freeLists.end());
+    for (auto &head : m->freeLists)
+        head = nullptr;
+    return ret;
+}
+
+
+void MemoryPool::rollback(const Mark &mark) {
+    KSL_PUBLIC(MemoryPool);
+    if (mark.depth + m->freeLists.size() > m->markedLists.size())
+        return;
+
+    // objects and large blocks are linked newest first
+    m->destroyObjects(mark.serial);
+    while (m->largeBlocks && m->largeBlocks->serial >= mark.serial)
+        m->freeLarge(m->largeBlocks + 1);
+
+    auto saved = m->markedLists.begin() + mark.depth;
+    std::copy(saved, saved + m->freeLists.size(), m->freeLists.begin());
+    m->markedLists.resize(mark.depth);
+    m->nextUnit = mark.unit;
+    m->pos = mark.pos;
+    m->end = mark.end;
+}
+
+
+void* MemoryPool::allocBytes(uint64_t amount, uint64_t alignment) {
+    KSL_PUBLIC(MemoryPool);
+    if (alignment > MemoryPoolPrivate::Granule) {
+        void *block = allocBytes(amount + alignment);
+        return block ? MemoryPoolPrivate::alignBlock(block, alignment) : nullptr;
     }
 
-    // If there is not enought space in the current unit but
-    // there is other units, allocate the next
-    if (m->unitsUsed < m->numUnits) {
-        m->units[m->unitsUsed] = new char[m->unitSize];
-        m->currUnit = m->units[m->unitsUsed++];
-        buffer = m->currUnit;
-        m->pos = m->currUnit + amount;
+    uint64_t size;
+    int index = MemoryPoolPrivate::sizeClass(amount, size);
+
+    // Buffers bigger than a unit come from the heap
+    if (size > m->unitSize)
+        return m->allocLarge(amount);
+
+    // Reuse a freed block of the same class
+    void *&head = m->freeLists[index];
+    if (head) {
+        void *buffer = head;
+        head = *static_cast<void**>(buffer);
         return buffer;
     }
 
-    // No way to return memory
-    return nullptr;
+    // Or take the next bytes of the newest unit,
+    // adding a unit if it is full
+    if (uint64_t(m->end - m->pos) < size && !m->addUnit())
+        return nullptr;
+    void *buffer = m->pos;
+    m->pos += size;
+    return buffer;
+}
+
+
+void MemoryPool::freeBytes(void *location, uint64_t size, uint64_t alignment) {
+    KSL_PUBLIC(MemoryPool);
+    if (!location)
+        return;
+    if (alignment > MemoryPoolPrivate::Granule) {
+        freeBytes(MemoryPoolPrivate::blockStart(location), size + alignment);
+        return;
+    }
+
+    uint64_t classSize;
+    int index = MemoryPoolPrivate::sizeClass(size, classSize);
+    if (classSize > m->unitSize) {
+        m->freeLarge(location);
+        return;
+    }
+    *static_cast<void**>(location) = m->freeLists[index];
+    m->freeLists[index] = location;
+}
+
+
+// Registers the object, to be destroyed with the pool
+void* MemoryPool::allocObject(uint64_t size, uint64_t alignment,
+                              void (*destroy)(void*))
+{
+    KSL_PUBLIC(MemoryPool);
+    uint64_t header = MemoryPoolPrivate::objectHeader(alignment);
+    char *block = (char*) allocBytes(header + size, alignment);
+    if (!block)
+        return nullptr;
+    auto object = reinterpret_cast<MemoryPoolObject*>(block + header) - 1;
+    object->destroy = destroy;
+    object->serial = m->serial++;
+    object->prev = nullptr;
+    object->next = m->objects;
+    if (m->objects)
+        m->objects->prev = object;
+    m->objects = object;
+    return block + header;
+}
+
+
+void MemoryPool::freeObject(void *location, uint64_t size,
+                            uint64_t alignment, bool destroy)
+{
+    KSL_PUBLIC(MemoryPool);
+    auto object = static_cast<MemoryPoolObject*>(location) - 1;
+    if (object->prev)
+        object->prev->next = object->next;
+    else
+        m->objects = object->next;
+    if (object->next)
+        object->next->prev = object->prev;
+    if (destroy)
+        object->destroy(location);
+    uint64_t header = MemoryPoolPrivate::objectHeader(alignment);
+    freeBytes(static_cast<char*>(location) - header, header + size, alignment);
+}
+
+
+// Index and size of the smallest class holding amount bytes
+int MemoryPoolPrivate::sizeClass(uint64_t amount, uint64_t &classSize) {
+    if (amount <= LinearLimit) {
+        int index = amount > 0 ? int((amount - 1) / Granule) : 0;
+        classSize = uint64_t(index + 1) * Granule;
+        return index;
+    }
+
+    // Four classes between 2^p and 2^(p+1)
+    uint64_t value = amount - 1;
+    int p = 0;
+#if defined(__GNUC__)
+    p = 63 - __builtin_clzll(value);
+#else
+    while (value >> (p + 1))
+        p += 1;
+#endif
+    uint64_t step = uint64_t(1) << (p - 2);
+    uint64_t sub = (value - (uint64_t(1) << p)) / step;
+    classSize = (uint64_t(1) << p) + (sub + 1) * step;
+    return int(LinearLimit / Granule) + (p - 8) * 4 + int(sub);
+}
+
+
+uint64_t MemoryPoolPrivate::classSizeAt(int index) {
+    const int linearClasses = int(LinearLimit / Granule);
+    if (index < linearClasses)
+        return uint64_t(index + 1) * Granule;
+    int p = 8 + (index - linearClasses) / 4;
+    int sub = (index - linearClasses) % 4;
+    return (uint64_t(1) << p) + uint64_t(sub + 1) * (uint64_t(1) << (p - 2));
+}
+
+
+// Starts a new unit, the rest of the current
+// one is split into free blocks
+bool MemoryPoolPrivate::addUnit() {
+    char *unit;
+    if (nextUnit < units.size()) {
+        unit = units[nextUnit];
+    } else {
+        unit = new (std::nothrow) char[unitSize];
+        if (!unit)
+            return false;
+        units.push_back(unit);
+        trackUnit();
+    }
+    if (pos)
+        recycle(pos, uint64_t(end - pos));
+    nextUnit += 1;
+    pos = unit;
+    end = unit + unitSize;
+    return true;
+}
+
+
+void MemoryPoolPrivate::recycle(char *block, uint64_t size) {
+    while (size >= Granule) {
+        uint64_t classSize;
+        int index = sizeClass(size, classSize);
+        if (classSize > size) {
+            index -= 1;
+            classSize = classSizeAt(index);
+        }
+        *reinterpret_cast<void**>(block) = freeLists[index];
+        freeLists[index] = block;
+        block += classSize;
+        size -= classSize;
+    }
+}
+
+
+// Objects created since serial "from", newest first,
+// as a destructor may free older objects
+void MemoryPoolPrivate::destroyObjects(uint64_t from) {
+    while (objects && objects->serial >= from) {
+        MemoryPoolObject *object = objects;
+        objects = object->next;
+        if (objects)
+            objects->prev = nullptr;
+        object->destroy(object + 1);
+    }
+}
+
+
+void* MemoryPoolPrivate::allocLarge(uint64_t amount) {
+    void *raw = ::operator new(sizeof(MemoryPoolLargeBlock) + amount,
+                               std::nothrow);
+    if (!raw)
+        return nullptr;
+    auto block = static_cast<MemoryPoolLargeBlock*>(raw);
+    block->prev = nullptr;
+    block->next = largeBlocks;
+    block->size = amount;
+    block->serial = serial++;
+    block->tracked = MemoryStats::isEnabled();
+    if (largeBlocks)
+        largeBlocks->prev = block;
+    largeBlocks = block;
+    if (block->tracked)
+        MemoryStats::allocated(MemoryStats::PoolUnits, qint64(amount));
+    return block + 1;
 }
 
 
-void MemoryPool::freeBytes(void *location, uint64_t size) {
-    // TODO
-    Q_UNUSED(location)
-    Q_UNUSED(size)
+void MemoryPoolPrivate::freeLarge(void *location) {
+    auto block = static_cast<MemoryPoolLargeBlock*>(location) - 1;
+    if (block->prev)
+        block->prev->next = block->next;
+    else
+        largeBlocks = block->next;
+    if (block->next)
+        block->next->prev = block->prev;
+    if (block->tracked)
+        MemoryStats::released(MemoryStats::PoolUnits, qint64(block->size));
+    ::operator delete(block);
 }
 
 KSL_END_NAMESPACE
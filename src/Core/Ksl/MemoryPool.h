@@ -22,10 +22,41 @@
 #define KSL_MEMORYPOOL_H
 
 #include <Ksl/Object.h>
+#include <Ksl/ArrayAllocator.h>
 #include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
 
 namespace Ksl {
 
+/*********************************************
+ * Pool of small blocks carved from units of
+ * unitSize bytes. Sizes are rounded to size
+ * classes and freed blocks go to the free list
+ * of their class, to be reused by the next
+ * allocation of the same class. numUnits units
+ * are reserved up front and more are added as
+ * needed. Blocks that don't fit in a unit come
+ * from the heap. freeBytes() must get the size
+ * and alignment given to allocBytes().
+ *
+ * Blocks are aligned to 16 bytes, or more when
+ * asked. Objects made by alloc() whose type
+ * has a destructor are registered, and are
+ * destroyed by free(), reset() or the pool's
+ * destructor, whichever comes first. Everything
+ * still held goes back to the system with the
+ * pool.
+ *
+ * mark() and rollback() give stack-like scopes:
+ * rollback() frees in one step all that was
+ * allocated after the mark and destroys the
+ * registered objects among it. Marks must be
+ * rolled back innermost first. Blocks allocated
+ * before a mark and freed inside its scope are
+ * only reused after reset().
+ *********************************************/
 class KSL_EXPORT MemoryPool
     : public Ksl::Object
 {
@@ -33,31 +64,148 @@ public:
 
     MemoryPool(uint64_t unitSize=1024, uint32_t numUnits=32);
 
+    uint64_t unitSize() const;
+
+    // Units taken from the system so far
+    uint32_t unitCount() const;
+
+    // Destroys the registered objects and makes all
+    // the memory free, keeping the units for reuse
+    void reset();
+
+
+    // Position of the pool, to roll back to
+    class Mark
+    {
+    private:
+
+        friend class MemoryPool;
+
+        std::size_t depth;
+        std::size_t unit;
+        char *pos;
+        char *end;
+        uint64_t serial;
+    };
+
+    Mark mark();
 
-    void* allocBytes(uint64_t amount);
+    void rollback(const Mark &mark);
 
-    void freeBytes(void *location, uint64_t size);
+
+    void* allocBytes(uint64_t amount, uint64_t alignment=16);
+
+    void freeBytes(void *location, uint64_t size, uint64_t alignment=16);
 
 
     template <typename T, typename... Args>
-    inline T* alloc(Args... args) {
-        return new (allocBytes(sizeof(T))) T(args...);
+    inline T* alloc(Args&&... args) {
+        void *ptr = std::is_trivially_destructible<T>::value
+            ? allocBytes(sizeof(T), alignof(T))
+            : allocObject(sizeof(T), alignof(T), &destroyObject<T>);
+        if (!ptr)
+            return nullptr;
+        try {
+            return new (ptr) T(std::forward<Args>(args)...);
+        } catch (...) {
+            if (std::is_trivially_destructible<T>::value)
+                freeBytes(ptr, sizeof(T), alignof(T));
+            else
+                freeObject(ptr, sizeof(T), alignof(T), false);
+            throw;
+        }
     }
 
+    // Uninitialized elements, aligned to alignof(T)
+    // or to alignment if it is bigger, e.g. 64 for
+    // the widest vector loads
     template <typename T>
-    inline T* allocArray(uint64_t size) {
-        return (T*) allocBytes(size*sizeof(T));
+    inline T* allocArray(uint64_t size, uint64_t alignment=alignof(T)) {
+        return (T*) allocBytes(size*sizeof(T), arrayAlignment<T>(alignment));
     }
 
     template <typename T>
     inline void free(T *ptr) {
-        freeBytes(ptr, sizeof(T));
+        if (!ptr)
+            return;
+        if (std::is_trivially_destructible<T>::value)
+            freeBytes(ptr, sizeof(T), alignof(T));
+        else
+            freeObject(ptr, sizeof(T), alignof(T), true);
     }
 
     template <typename T>
-    inline void freeArray(T *ptr, uint64_t size) {
-        freeBytes(ptr, size*sizeof(T));
+    inline void freeArray(T *ptr, uint64_t size, uint64_t alignment=alignof(T)) {
+        freeBytes(ptr, size*sizeof(T), arrayAlignment<T>(alignment));
     }
+
+
+private:
+
+    template <typename T>
+    static void destroyObject(void *ptr) {
+        static_cast<T*>(ptr)->~T();
+    }
+
+    template <typename T>
+    static uint64_t arrayAlignment(uint64_t alignment) {
+        return alignment > alignof(T) ? alignment : alignof(T);
+    }
+
+    void* allocObject(uint64_t size, uint64_t alignment,
+                      void (*destroy)(void*));
+
+    void freeObject(void *location, uint64_t size, uint64_t alignment,
+                    bool destroy);
+};
+
+
+/*********************************************
+ * Marks a pool and rolls it back at the end of
+ * the scope, for per-frame temporaries. Unless
+ * told otherwise, the arrays created in the
+ * thread meanwhile take their storage from the
+ * pool too, so they must not outlive the scope.
+ * Arrays that already hold storage keep their
+ * allocator when they detach, take a result or
+ * are assigned an array of the scope, which is
+ * then copied. Empty arrays have no allocator
+ * yet and take the arena storage like new ones.
+ *********************************************/
+class ArenaScope
+{
+public:
+
+    ArenaScope(MemoryPool *pool, bool arrays=true)
+        : m_pool(pool)
+        , m_mark(pool->mark())
+        , m_allocator(pool)
+        , m_previous(nullptr)
+        , m_arrays(arrays)
+    {
+        if (m_arrays)
+            m_previous = ArrayAllocator::setCurrent(&m_allocator);
+    }
+
+    ~ArenaScope() {
+        if (m_arrays)
+            ArrayAllocator::setCurrent(m_previous);
+        m_pool->rollback(m_mark);
+    }
+
+    MemoryPool* pool() const { return m_pool; }
+
+
+private:
+
+    ArenaScope(const ArenaScope&);
+    ArenaScope& operator= (const ArenaScope&);
+
+    MemoryPool *m_pool;
+    MemoryPool::Mark m_mark;
+    PoolAllocator m_allocator;
+    ArrayAllocator *m_previous;
+    bool m_arrays;
 };
 
 } // namespace Ksl
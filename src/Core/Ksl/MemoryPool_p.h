@@ -33,25 +33,122 @@
 #define KSL_MEMORYPOOL_P_H
 
 #include <Ksl/MemoryPool.h>
+#include <Ksl/MemoryStats.h>
+#include <cstring>
+#include <vector>
 
 namespace Ksl {
 
+// Header in front of the blocks too big for a unit,
+// they are linked to be freed with the pool
+struct alignas(16) MemoryPoolLargeBlock
+{
+    MemoryPoolLargeBlock *prev;
+    MemoryPoolLargeBlock *next;
+    uint64_t size;
+    uint64_t serial;
+    bool tracked;
+};
+
+
+// Header in front of the objects with destructors,
+// linked to be destroyed with the pool
+struct alignas(16) MemoryPoolObject
+{
+    MemoryPoolObject *prev;
+    MemoryPoolObject *next;
+    void (*destroy)(void*);
+    uint64_t serial;
+};
+
+
 class MemoryPoolPrivate
     : public Ksl::ObjectPrivate
 {
 public:
 
+    // Block sizes are multiples of Granule, every
+    // Granule bytes up to LinearLimit and then four
+    // classes per power of two
+    static const uint64_t Granule = 16;
+    static const uint64_t LinearLimit = 256;
+
     MemoryPoolPrivate(MemoryPool *publ)
         : Ksl::ObjectPrivate(publ)
+        , pos(nullptr)
+        , end(nullptr)
+        , nextUnit(0)
+        , largeBlocks(nullptr)
+        , objects(nullptr)
+        , serial(0)
+        , trackedUnits(0)
     { }
 
+    ~MemoryPoolPrivate();
+
+    static int sizeClass(uint64_t amount, uint64_t &classSize);
+
+    static uint64_t classSizeAt(int index);
+
+    bool addUnit();
+
+    void recycle(char *block, uint64_t size);
+
+    void* allocLarge(uint64_t amount);
+
+    void freeLarge(void *location);
+
+    void destroyObjects(uint64_t from=0);
+
+    // Blocks aligned to more than Granule bytes are
+    // over allocated, and the distance from the
+    // start, at least Granule, is kept in front
+    static void* alignBlock(void *block, uint64_t alignment) {
+        uint64_t offset = alignment - quintptr(block) % alignment;
+        char *ptr = static_cast<char*>(block) + offset;
+        std::memcpy(ptr - sizeof(offset), &offset, sizeof(offset));
+        return ptr;
+    }
+
+    static void* blockStart(void *ptr) {
+        uint64_t offset;
+        std::memcpy(&offset, static_cast<char*>(ptr) - sizeof(offset), sizeof(offset));
+        return static_cast<char*>(ptr) - offset;
+    }
+
+    // Bytes in front of an object of the given alignment
+    static uint64_t objectHeader(uint64_t alignment) {
+        return alignment > sizeof(MemoryPoolObject)
+            ? alignment : sizeof(MemoryPoolObject);
+    }
+
+    void trackUnit() {
+        if (MemoryStats::isEnabled()) {
+            MemoryStats::allocated(MemoryStats::PoolUnits, qint64(unitSize));
+            trackedUnits += 1;
+        }
+    }
+
 
     uint64_t unitSize;
-    uint32_t numUnits;
-    uint32_t unitsUsed;
-    char **units;
-    char *currUnit;
+    std::vector<char*> units;
+    // Free space at the end of the unit in use
     char *pos;
+    char *end;
+    // Next of the units to use, they are reused after reset()
+    std::size_t nextUnit;
+    // Heads of the free lists, one per size class.
+    // A free block holds the next one of its list
+    std::vector<void*> freeLists;
+    MemoryPoolLargeBlock *largeBlocks;
+    // Newest object with a destructor
+    MemoryPoolObject *objects;
+    // Order of creation of the objects and large blocks
+    uint64_t serial;
+    // Free list heads hidden by each open mark
+    std::vector<void*> markedLists;
+    // Units counted by MemoryStats
+    uint32_t trackedUnits;
 };
 
 } // namespace Ksl
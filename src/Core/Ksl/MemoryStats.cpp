@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2016  Elvis Teixeira
+ *
+ * This source code is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General
+ * Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This source code is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <Ksl/MemoryStats.h>
+#include <cstdlib>
+
+namespace Ksl {
+
+namespace {
+
+struct SubsystemCounters
+{
+    std::atomic<qint64> liveBytes;
+    std::atomic<qint64> peakBytes;
+    std::atomic<qint64> allocations;
+    std::atomic<qint64> releases;
+};
+
+
+// One slot per subsystem and the total at the end
+SubsystemCounters& slot(int index) {
+    static SubsystemCounters counters[MemoryStats::SubsystemCount + 1] = { };
+    return counters[index];
+}
+
+
+void add(SubsystemCounters &counters, qint64 bytes) {
+    qint64 live = counters.liveBytes.fetch_add(
+        bytes, std::memory_order_relaxed) + bytes;
+    qint64 peak = counters.peakBytes.load(std::memory_order_relaxed);
+    while (live > peak &&
+           !counters.peakBytes.compare_exchange_weak(
+               peak, live, std::memory_order_relaxed))
+    { }
+    counters.allocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+void remove(SubsystemCounters &counters, qint64 bytes) {
+    counters.liveBytes.fetch_sub(bytes, std::memory_order_relaxed);
+    counters.releases.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+MemoryStats::Counters load(const SubsystemCounters &counters) {
+    MemoryStats::Counters ret;
+    ret.liveBytes = counters.liveBytes.load(std::memory_order_relaxed);
+    ret.peakBytes = counters.peakBytes.load(std::memory_order_relaxed);
+    ret.allocations = counters.allocations.load(std::memory_order_relaxed);
+    ret.releases = counters.releases.load(std::memory_order_relaxed);
+    return ret;
+}
+
+
+QString countersJson(const MemoryStats::Counters &counters) {
+    return QString("{\"liveBytes\": %1, \"peakBytes\": %2, "
+                   "\"allocations\": %3, \"releases\": %4}")
+        .arg(counters.liveBytes)
+        .arg(counters.peakBytes)
+        .arg(counters.allocations)
+        .arg(counters.releases);
+}
+
+} // namespace
+
+
+bool MemoryStats::enabledByEnvironment() {
+    const char *value = std::getenv("KSL_MEMORY_STATS");
+    return value && *value && *value != '0';
+}
+
+
+void MemoryStats::setEnabled(bool enabled) {
+    enabledFlag().store(enabled, std::memory_order_relaxed);
+}
+
+
+void MemoryStats::allocated(Subsystem subsystem, qint64 bytes) {
+    add(slot(subsystem), bytes);
+    add(slot(SubsystemCount), bytes);
+}
+
+
+void MemoryStats::released(Subsystem subsystem, qint64 bytes) {
+    remove(slot(subsystem), bytes);
+    remove(slot(SubsystemCount), bytes);
+}
+
+
+MemoryStats::Counters MemoryStats::counters(Subsystem subsystem) {
+    return load(slot(subsystem));
+}
+
+
+MemoryStats::Counters MemoryStats::total() {
+    return load(slot(SubsystemCount));
+}
+
+
+void MemoryStats::reset() {
+    for (int k=0; k<=SubsystemCount; ++k) {
+        SubsystemCounters &counters = slot(k);
+        counters.peakBytes.store(
+            counters.liveBytes.load(std::memory_order_relaxed),
+            std::memory_order_relaxed);
+        counters.allocations.store(0, std::memory_order_relaxed);
+        counters.releases.store(0, std::memory_order_relaxed);
+    }
+}
+
+
+const char* MemoryStats::name(Subsystem subsystem) {
+    switch (subsystem) {
+    case Arrays: return "arrays";
+    case CsvData: return "csv";
+    case PoolUnits: return "pools";
+    case Plotting: return "plotting";
+    default: return "unknown";
+    }
+}
+
+
+QString MemoryStats::toJson() {
+    QString ret = QString("{\"enabled\": %1, \"subsystems\": {")
+        .arg(isEnabled() ? "true" : "false");
+    for (int k=0; k<SubsystemCount; ++k) {
+        Subsystem subsystem = Subsystem(k);
+        if (k > 0) {
+            ret += ", ";
+        }
+        ret += QString("\"%1\": ").arg(name(subsystem));
+        ret += countersJson(counters(subsystem));
+    }
+    ret += "}, \"total\": ";
+    ret += countersJson(total());
+    ret += "}";
+    return ret;
+}
+
+
+QString MemoryStats::jsonString(const QString &str) {
+    QString ret("\"");
+    for (int k=0; k<str.size(); ++k) {
+        QChar c = str[k];
+        switch (c.unicode()) {
+        case '"': ret += "\\\""; break;
+        case '\\': ret += "\\\\"; break;
+        case '\n': ret += "\\n"; break;
+        case '\r': ret += "\\r"; break;
+        case '\t': ret += "\\t"; break;
+        default:
+            if (c.unicode() < 0x20) {
+                ret += QString("\\u%1").arg(int(c.unicode()), 4, 16, QChar('0'));
+            } else {
+                ret += c;
+            }
+        }
+    }
+    ret += "\"";
+    return ret;
+}
+
+} // namespace Ksl
@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2016  Elvis Teixeira
+ *
+ * This source code is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General
+ * Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This source code is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef KSL_MEMORYSTATS_H
+#define KSL_MEMORYSTATS_H
+
+#include <Ksl/Global.h>
+#include <QString>
+#include <atomic>
+
+namespace Ksl {
+
+/*********************************************
+ * Opt-in accounting of the memory held by the
+ * library. Counting starts when setEnabled()
+ * is called or when the KSL_MEMORY_STATS
+ * environment variable is set, and only blocks
+ * created while it is on are counted. Array
+ * buffers are charged to the subsystem of the
+ * thread's innermost Scope, Arrays by default.
+ *********************************************/
+class KSL_EXPORT MemoryStats
+{
+public:
+
+    enum Subsystem {
+        Arrays,
+        CsvData,
+        PoolUnits,
+        Plotting,
+        SubsystemCount
+    };
+
+    struct Counters {
+        qint64 liveBytes;
+        qint64 peakBytes;
+        qint64 allocations;
+        qint64 releases;
+    };
+
+    // Charges the array buffers created in this
+    // thread to a subsystem while it lives
+    class Scope
+    {
+    public:
+
+        Scope(Subsystem subsystem)
+            : m_previous(currentSlot())
+        {
+            currentSlot() = subsystem;
+        }
+
+        ~Scope() { currentSlot() = m_previous; }
+
+
+    private:
+
+        Scope(const Scope&);
+        Scope& operator= (const Scope&);
+
+        Subsystem m_previous;
+    };
+
+
+    static bool isEnabled() {
+        return enabledFlag().load(std::memory_order_relaxed);
+    }
+
+    static void setEnabled(bool enabled);
+
+    static Subsystem current() { return currentSlot(); }
+
+    static void allocated(Subsystem subsystem, qint64 bytes);
+
+    static void released(Subsystem subsystem, qint64 bytes);
+
+    static Counters counters(Subsystem subsystem);
+
+    // Sum over all subsystems, the peak is the
+    // highest total seen, not the sum of peaks
+    static Counters total();
+
+    // Zeroes the counts and brings the peaks
+    // down to the live bytes
+    static void reset();
+
+    static const char* name(Subsystem subsystem);
+
+    // Object with the counters of every subsystem
+    // and their total
+    static QString toJson();
+
+    // Quoted and escaped JSON string
+    static QString jsonString(const QString &str);
+
+
+private:
+
+    static std::atomic<bool>& enabledFlag() {
+        static std::atomic<bool> flag(enabledByEnvironment());
+        return flag;
+    }
+
+    static bool enabledByEnvironment();
+
+    static Subsystem& currentSlot() {
+        static thread_local Subsystem slot = Arrays;
+        return slot;
+    }
+};
+
+} // namespace Ksl
+
+#endif // KSL_MEMORYSTATS_H
@@ -0,0 +1,537 @@
+/*
+ * Copyright (C) 2016  Elvis Teixeira
+ *
+ * This source code is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General
+ * Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This source code is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <Ksl/Npy_p.h>
+#include <QDebug>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace Ksl {
+
+namespace {
+
+quint64 readLE(const char *data, int bytes) {
+    quint64 ret = 0;
+    for (int k=bytes-1; k>=0; --k) {
+        ret = (ret << 8) | quint8(data[k]);
+    }
+    return ret;
+}
+
+
+void appendLE(QByteArray &out, quint64 value, int bytes) {
+    for (int k=0; k<bytes; ++k) {
+        out.append(char(value & 0xff));
+        value >>= 8;
+    }
+}
+
+
+// Running CRC-32 of zip files, start and finish
+// with crc ^ 0xffffffff
+quint32 crc32(quint32 crc, const char *data, qint64 size) {
+    // built once, thread safe as a local static
+    static const std::vector<quint32> table = []() {
+        std::vector<quint32> ret(256);
+        for (quint32 n=0; n<256; ++n) {
+            quint32 c = n;
+            for (int k=0; k<8; ++k) {
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            }
+            ret[n] = c;
+        }
+        return ret;
+    }();
+    for (qint64 k=0; k<size; ++k) {
+        crc = table[(crc ^ quint8(data[k])) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+
+// Value of "key" in the Python dict literal of the header
+std::string dictValue(const std::string &dict, const char *key) {
+    size_t pos = dict.find(std::string("'") + key + "'");
+    if (pos == std::string::npos) {
+        return std::string();
+    }
+    pos = dict.find(':', pos);
+    if (pos == std::string::npos) {
+        return std::string();
+    }
+    pos = dict.find_first_not_of(' ', pos + 1);
+    if (pos == std::string::npos) {
+        return std::string();
+    }
+    size_t end;
+    if (dict[pos] == '\'' || dict[pos] == '"') {
+        end = dict.find(dict[pos], pos + 1);
+        pos += 1;
+    } else if (dict[pos] == '(') {
+        end = dict.find(')', pos) + 1;
+    } else {
+        end = dict.find_first_of(",}", pos);
+    }
+    if (end == std::string::npos || end == 0) {
+        return std::string();
+    }
+    return dict.substr(pos, end - pos);
+}
+
+
+bool parseHeader(const std::string &dict, NpyHeader &header) {
+    std::string descr = dictValue(dict, "descr");
+    std::string order = dictValue(dict, "fortran_order");
+    std::string shape = dictValue(dict, "shape");
+    if (descr.size() < 3 || order.empty() || shape.empty()) {
+        return false;
+    }
+
+    bool hostBig = npyHostIsBigEndian();
+    switch (descr[0]) {
+    case '<': header.bigEndian = false; break;
+    case '>': header.bigEndian = true; break;
+    case '|':
+    case '=': header.bigEndian = hostBig; break;
+    default: return false;
+    }
+    header.kind = descr[1];
+    header.itemSize = std::atoi(descr.c_str() + 2);
+    if (std::string("fiub").find(header.kind) == std::string::npos ||
+        (header.itemSize != 1 && header.itemSize != 2 &&
+         header.itemSize != 4 && header.itemSize != 8))
+    {
+        return false;
+    }
+    header.fortranOrder = (order.compare(0, 4, "True") == 0);
+
+    header.shape.clear();
+    const char *ptr = shape.c_str() + 1;
+    while (*ptr && *ptr != ')') {
+        char *end;
+        long long dim = std::strtoll(ptr, &end, 10);
+        if (end == ptr) {
+            ptr += 1;
+            continue;
+        }
+        if (dim < 0) {
+            return false;
+        }
+        header.shape.append(Index(dim));
+        ptr = end;
+    }
+    return true;
+}
+
+
+// The product of the dimensions is at most "limit",
+// checked without overflowing
+bool countFits(const QVector<Index> &shape, qint64 limit) {
+    for (Index dim : shape) {
+        if (dim == 0) {
+            return true;
+        }
+    }
+    qint64 count = 1;
+    for (Index dim : shape) {
+        if (qint64(dim) > limit / count) {
+            return false;
+        }
+        count *= qint64(dim);
+    }
+    return true;
+}
+
+} // namespace
+
+
+Index NpyHeader::count() const {
+    Index ret = 1;
+    for (Index dim : shape) {
+        ret *= dim;
+    }
+    return ret;
+}
+
+
+void NpyHeader::arrayShape(int D, Index &rows, Index &cols) const {
+    Index size = count();
+    if (D == 1 || shape.size() < 2) {
+        rows = size > 0 ? 1 : 0;
+        cols = size;
+    } else {
+        rows = size > 0 ? shape[0] : 0;
+        cols = size > 0 ? size/shape[0] : 0;
+    }
+}
+
+
+bool NpyHeader::read(const QString &filePath, qint64 offset,
+                     NpyHeader &header)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly) || !file.seek(offset)) {
+        qDebug() << "NpyHeader::read: File not found!";
+        return false;
+    }
+
+    QByteArray prefix = file.read(10);
+    if (prefix.size() < 10 ||
+        std::memcmp(prefix.constData(), "\x93NUMPY", 6) != 0)
+    {
+        qDebug() << "NpyHeader::read: Not a .npy file!";
+        return false;
+    }
+    int version = quint8(prefix[6]);
+    qint64 start, length;
+    if (version == 1) {
+        start = 10;
+        length = readLE(prefix.constData() + 8, 2);
+    } else if (version == 2 || version == 3) {
+        prefix.append(file.read(2));
+        if (prefix.size() < 12) {
+            return false;
+        }
+        start = 12;
+        length = readLE(prefix.constData() + 8, 4);
+    } else {
+        qDebug() << "NpyHeader::read: Unknown .npy version!";
+        return false;
+    }
+
+    QByteArray dict = file.read(length);
+    if (dict.size() < length ||
+        !parseHeader(std::string(dict.constData(), dict.size()), header))
+    {
+        qDebug() << "NpyHeader::read: Unsupported .npy header!";
+        return false;
+    }
+    header.dataOffset = offset + start + length;
+
+    // A corrupt shape could overflow the element count,
+    // the elements must fit in the rest of the file
+    if (!countFits(header.shape,
+                   (file.size() - header.dataOffset) / header.itemSize))
+    {
+        qDebug() << "NpyHeader::read: Shape larger than the file!";
+        return false;
+    }
+    return true;
+}
+
+
+bool NpyHeader::readNpz(const QString &filePath, const QString &name,
+                        NpyHeader &header)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qDebug() << "NpyHeader::readNpz: File not found!";
+        return false;
+    }
+
+    // The end of central directory record is in the last
+    // 64k of the file, before the archive comment
+    qint64 tailSize = qMin(file.size(), qint64(65557));
+    file.seek(file.size() - tailSize);
+    QByteArray tail = file.read(tailSize);
+    int eocd = tail.size() - 22;
+    while (eocd >= 0 && std::memcmp(tail.constData() + eocd, "PK\x05\x06", 4) != 0) {
+        eocd -= 1;
+    }
+    if (eocd < 0) {
+        qDebug() << "NpyHeader::readNpz: Not a .npz file!";
+        return false;
+    }
+    const char *rec = tail.constData() + eocd;
+    quint64 entries = readLE(rec + 10, 2);
+    quint64 cdSize = readLE(rec + 12, 4);
+    quint64 cdOffset = readLE(rec + 16, 4);
+    if (entries == 0xffff || cdSize == 0xffffffff || cdOffset == 0xffffffff) {
+        // Zip64 archive, its record is found through a locator
+        if (eocd < 20 || std::memcmp(rec - 20, "PK\x06\x07", 4) != 0) {
+            return false;
+        }
+        file.seek(qint64(readLE(rec - 20 + 8, 8)));
+        QByteArray rec64 = file.read(56);
+        if (rec64.size() < 56 ||
+            std::memcmp(rec64.constData(), "PK\x06\x06", 4) != 0)
+        {
+            return false;
+        }
+        entries = readLE(rec64.constData() + 32, 8);
+        cdSize = readLE(rec64.constData() + 40, 8);
+        cdOffset = readLE(rec64.constData() + 48, 8);
+    }
+
+    file.seek(qint64(cdOffset));
+    QByteArray cd = file.read(qint64(cdSize));
+    if (quint64(cd.size()) < cdSize) {
+        return false;
+    }
+
+    QByteArray wanted = name.toUtf8();
+    QByteArray wantedNpy = wanted + ".npy";
+    qint64 pos = 0;
+    for (quint64 e=0; e<entries; ++e) {
+        if (pos + 46 > cd.size()) {
+            return false;
+        }
+        const char *ptr = cd.constData() + pos;
+        if (std::memcmp(ptr, "PK\x01\x02", 4) != 0) {
+            return false;
+        }
+        int method = int(readLE(ptr + 10, 2));
+        quint64 size = readLE(ptr + 24, 4);
+        quint64 compressed = readLE(ptr + 20, 4);
+        quint64 local = readLE(ptr + 42, 4);
+        int nameLength = int(readLE(ptr + 28, 2));
+        int extraLength = int(readLE(ptr + 30, 2));
+        int commentLength = int(readLE(ptr + 32, 2));
+        if (pos + 46 + nameLength + extraLength + commentLength > cd.size()) {
+            return false;
+        }
+        QByteArray entryName(ptr + 46, nameLength);
+
+        if (entryName == wanted || entryName == wantedNpy) {
+            // 64 bit values are in the zip64 extra field
+            const char *extra = ptr + 46 + nameLength;
+            const char *extraEnd = extra + extraLength;
+            while (extra + 4 <= extraEnd) {
+                int tag = int(readLE(extra, 2));
+                int length = int(readLE(extra + 2, 2));
+                const char *field = extra + 4;
+                const char *fieldEnd = field + length;
+                if (fieldEnd > extraEnd) {
+                    return false;
+                }
+                if (tag == 1) {
+                    quint64 *values[] = { &size, &compressed, &local };
+                    for (quint64 *value : values) {
+                        if (*value != 0xffffffff) {
+                            continue;
+                        }
+                        if (field + 8 > fieldEnd) {
+                            return false;
+                        }
+                        *value = readLE(field, 8);
+                        field += 8;
+                    }
+                }
+                extra = fieldEnd;
+            }
+            if (method != 0 || compressed != size) {
+                qDebug() << "NpyHeader::readNpz: Compressed entries are not supported!";
+                return false;
+            }
+            file.seek(qint64(local));
+            QByteArray localHeader = file.read(30);
+            if (localHeader.size() < 30 ||
+                std::memcmp(localHeader.constData(), "PK\x03\x04", 4) != 0)
+            {
+                return false;
+            }
+            qint64 data = qint64(local) + 30 +
+                qint64(readLE(localHeader.constData() + 26, 2)) +
+                qint64(readLE(localHeader.constData() + 28, 2));
+            file.close();
+            return read(filePath, data, header);
+        }
+        pos += 46 + nameLength + extraLength + commentLength;
+    }
+    qDebug() << "NpyHeader::readNpz: Array not found!";
+    return false;
+}
+
+
+QByteArray NpyHeader::make(char kind, int itemSize, bool fortranOrder,
+                           const QVector<Index> &shape)
+{
+    QByteArray dict("{'descr': '");
+    if (itemSize == 1) {
+        dict.append('|');
+    } else {
+        dict.append(npyHostIsBigEndian() ? '>' : '<');
+    }
+    dict.append(kind);
+    dict.append(QByteArray::number(itemSize));
+    dict.append("', 'fortran_order': ");
+    dict.append(fortranOrder ? "True" : "False");
+    dict.append(", 'shape': (");
+    for (int k=0; k<shape.size(); ++k) {
+        dict.append(QByteArray::number(qlonglong(shape[k])));
+        if (k+1 < shape.size() || shape.size() == 1) {
+            dict.append(shape.size() == 1 ? "," : ", ");
+        }
+    }
+    dict.append("), }");
+
+    // Pad with spaces and a newline to align the
+    // elements to 64 bytes
+    int prefix = (dict.size() + 11 > 65535) ? 12 : 10;
+    int padding = 63 - (prefix + dict.size()) % 64;
+    dict.append(QByteArray(padding, ' '));
+    dict.append('\n');
+
+    QByteArray ret("\x93NUMPY");
+    ret.append(char(prefix == 10 ? 1 : 2));
+    ret.append(char(0));
+    appendLE(ret, quint64(dict.size()), prefix - 8);
+    ret.append(dict);
+    return ret;
+}
+
+
+bool npyWrite(const QString &filePath, const QByteArray &header,
+              const char *data, qint64 bytes)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly|QIODevice::Truncate)) {
+        qDebug() << "npyWrite: Can't open file!";
+        return false;
+    }
+    return file.write(header) == header.size() &&
+           (bytes == 0 || file.write(data, bytes) == bytes);
+}
+
+
+NpzWriter::NpzWriter(const QString &filePath)
+    : Ksl::Object(new NpzWriterPrivate(this))
+{
+    KSL_PUBLIC(NpzWriter);
+    m->file.setFileName(filePath);
+    if (!m->file.open(QIODevice::WriteOnly|QIODevice::Truncate)) {
+        qDebug() << "NpzWriter: Can't open file!";
+    }
+}
+
+
+NpzWriter::~NpzWriter() {
+    close();
+}
+
+
+bool NpzWriter::isOpen() const {
+    KSL_PUBLIC(const NpzWriter);
+    return m->file.isOpen();
+}
+
+
+bool NpzWriter::addEntry(const QString &name, const QByteArray &header,
+                         const char *data, qint64 bytes)
+{
+    KSL_PUBLIC(NpzWriter);
+    if (!m->file.isOpen()) {
+        return false;
+    }
+    QByteArray fileName = name.toUtf8();
+    if (!fileName.endsWith(".npy")) {
+        fileName.append(".npy");
+    }
+
+    // Entries are written without the zip64 extensions
+    qint64 offset = m->file.pos();
+    qint64 size = header.size() + bytes;
+    if (offset + 30 + fileName.size() + size > qint64(0xffffffff)) {
+        qDebug() << "NpzWriter::add: The .npz file would exceed 4GB!";
+        return false;
+    }
+
+    quint32 crc = crc32(0xffffffff, header.constData(), header.size());
+    crc = crc32(crc, data, bytes) ^ 0xffffffff;
+
+    QByteArray local;
+    appendLE(local, 0x04034b50, 4);
+    appendLE(local, 20, 2);             // version needed
+    appendLE(local, 0, 2);              // flags
+    appendLE(local, 0, 2);              // stored
+    appendLE(local, 0, 2);              // time
+    appendLE(local, 0x21, 2);           // date, 1980-01-01
+    appendLE(local, crc, 4);
+    appendLE(local, quint64(size), 4);
+    appendLE(local, quint64(size), 4);
+    appendLE(local, quint64(fileName.size()), 2);
+    appendLE(local, 0, 2);
+    local.append(fileName);
+
+    if (m->file.write(local) != local.size() ||
+        m->file.write(header) != header.size() ||
+        (bytes > 0 && m->file.write(data, bytes) != bytes))
+    {
+        qDebug() << "NpzWriter::add: Write error!";
+        return false;
+    }
+
+    NpzWriterPrivate::Entry entry;
+    entry.name = fileName;
+    entry.crc = crc;
+    entry.size = quint32(size);
+    entry.offset = quint32(offset);
+    m->entries.append(entry);
+    return true;
+}
+
+
+bool NpzWriter::close() {
+    KSL_PUBLIC(NpzWriter);
+    if (!m->file.isOpen()) {
+        return false;
+    }
+
+    qint64 cdOffset = m->file.pos();
+    QByteArray cd;
+    for (auto &entry : m->entries) {
+        appendLE(cd, 0x02014b50, 4);
+        appendLE(cd, 20, 2);            // version made by
+        appendLE(cd, 20, 2);            // version needed
+        appendLE(cd, 0, 2);             // flags
+        appendLE(cd, 0, 2);             // stored
+        appendLE(cd, 0, 2);             // time
+        appendLE(cd, 0x21, 2);          // date
+        appendLE(cd, entry.crc, 4);
+        appendLE(cd, entry.size, 4);
+        appendLE(cd, entry.size, 4);
+        appendLE(cd, quint64(entry.name.size()), 2);
+        appendLE(cd, 0, 2);             // extra field
+        appendLE(cd, 0, 2);             // comment
+        appendLE(cd, 0, 2);             // disk
+        appendLE(cd, 0, 2);             // internal attributes
+        appendLE(cd, 0, 4);             // external attributes
+        appendLE(cd, entry.offset, 4);
+        cd.append(entry.name);
+    }
+    qint64 cdSize = cd.size();
+    appendLE(cd, 0x06054b50, 4);
+    appendLE(cd, 0, 2);
+    appendLE(cd, 0, 2);
+    appendLE(cd, quint64(m->entries.size()), 2);
+    appendLE(cd, quint64(m->entries.size()), 2);
+    appendLE(cd, quint64(cdSize), 4);
+    appendLE(cd, quint64(cdOffset), 4);
+    appendLE(cd, 0, 2);
+
+    bool ok = (m->file.write(cd) == cd.size());
+    m->file.close();
+    m->entries.clear();
+    return ok;
+}
+
+} // namespace Ksl
@@ -0,0 +1,298 @@
+/*
+ * Copyright (C) 2016  Elvis Teixeira
+ *
+ * This source code is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General
+ * Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This source code is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef KSL_NPY_H
+#define KSL_NPY_H
+
+#include <Ksl/Object.h>
+#include <Ksl/ArrayMapping.h>
+#include <QByteArray>
+#include <QVector>
+#include <algorithm>
+#include <cstring>
+
+namespace Ksl {
+
+/*********************************************
+ * Description of an array stored in NumPy's
+ * .npy format, alone or inside a .npz file
+ *********************************************/
+struct KSL_EXPORT NpyHeader
+{
+    // 'f' float, 'i' signed, 'u' unsigned or 'b' bool
+    char kind;
+    int itemSize;
+    bool bigEndian;
+    bool fortranOrder;
+    QVector<Index> shape;
+    // Position of the elements in the file
+    qint64 dataOffset;
+
+    Index count() const;
+
+    // Reads the header of the .npy data found at
+    // "offset" in the file
+    static bool read(const QString &filePath, qint64 offset,
+                     NpyHeader &header);
+
+    // Finds the .npy data of an array in a .npz file,
+    // the entry must be stored without compression
+    static bool readNpz(const QString &filePath, const QString &name,
+                        NpyHeader &header);
+
+    // The magic string, version and header of a .npy
+    // file, padded for the elements to be aligned
+    static QByteArray make(char kind, int itemSize, bool fortranOrder,
+                           const QVector<Index> &shape);
+
+    // The shape as rows and columns of a D dimensional array
+    void arrayShape(int D, Index &rows, Index &cols) const;
+};
+
+
+/*********************************************
+ * Element types with a NumPy dtype
+ *********************************************/
+template <typename Tp>
+struct NpyType {
+    static const bool isValid = false;
+};
+
+#define KSL_NPY_TYPE(Type, Kind) \
+    template <> struct NpyType<Type> { \
+        static const bool isValid = true; \
+        static const char kind = Kind; \
+    };
+
+KSL_NPY_TYPE(float, 'f')
+KSL_NPY_TYPE(double, 'f')
+KSL_NPY_TYPE(signed char, 'i')
+KSL_NPY_TYPE(short, 'i')
+KSL_NPY_TYPE(int, 'i')
+KSL_NPY_TYPE(long, 'i')
+KSL_NPY_TYPE(long long, 'i')
+KSL_NPY_TYPE(unsigned char, 'u')
+KSL_NPY_TYPE(unsigned short, 'u')
+KSL_NPY_TYPE(unsigned int, 'u')
+KSL_NPY_TYPE(unsigned long, 'u')
+KSL_NPY_TYPE(unsigned long long, 'u')
+KSL_NPY_TYPE(bool, 'b')
+
+#undef KSL_NPY_TYPE
+
+
+inline bool npyHostIsBigEndian() {
+    return Q_BYTE_ORDER == Q_BIG_ENDIAN;
+}
+
+
+template <typename Src, typename Tp> inline
+void npyConvert(const char *src, Tp *dest, Index size, bool swap) {
+    for (Index k=0; k<size; ++k) {
+        char bytes[sizeof(Src)];
+        std::memcpy(bytes, src + k*Index(sizeof(Src)), sizeof(Src));
+        if (swap) {
+            std::reverse(bytes, bytes + sizeof(Src));
+        }
+        Src value;
+        std::memcpy(&value, bytes, sizeof(Src));
+        dest[k] = Tp(value);
+    }
+}
+
+
+// Converts the elements of any numeric dtype to Tp
+template <typename Tp>
+bool npyConvert(const NpyHeader &header, const char *src,
+                Tp *dest, Index size)
+{
+    bool swap = (header.bigEndian != npyHostIsBigEndian());
+    switch (header.kind) {
+    case 'f':
+        if (header.itemSize == 4) { npyConvert<float>(src, dest, size, swap); return true; }
+        if (header.itemSize == 8) { npyConvert<double>(src, dest, size, swap); return true; }
+        break;
+    case 'i':
+        if (header.itemSize == 1) { npyConvert<qint8>(src, dest, size, swap); return true; }
+        if (header.itemSize == 2) { npyConvert<qint16>(src, dest, size, swap); return true; }
+        if (header.itemSize == 4) { npyConvert<qint32>(src, dest, size, swap); return true; }
+        if (header.itemSize == 8) { npyConvert<qint64>(src, dest, size, swap); return true; }
+        break;
+    case 'u':
+    case 'b':
+        if (header.itemSize == 1) { npyConvert<quint8>(src, dest, size, swap); return true; }
+        if (header.itemSize == 2) { npyConvert<quint16>(src, dest, size, swap); return true; }
+        if (header.itemSize == 4) { npyConvert<quint32>(src, dest, size, swap); return true; }
+        if (header.itemSize == 8) { npyConvert<quint64>(src, dest, size, swap); return true; }
+        break;
+    }
+    return false;
+}
+
+
+// Builds the array described by header. The file is mapped
+// into the storage, without copies, if its elements are of
+// type Tp in the host byte order; any other numeric dtype
+// is converted
+template <int D, typename Tp>
+Array<D,Tp> npyLoad(const QString &filePath, const NpyHeader &header,
+                    ArrayMapping::Mode mode)
+{
+    Index rows, cols;
+    header.arrayShape(D, rows, cols);
+    Index size = rows*cols;
+    if (size == 0) {
+        return Array<D,Tp>();
+    }
+    qint64 bytes = qint64(size)*header.itemSize;
+    ArrayMapping *mapping = ArrayMapping::map(filePath, header.dataOffset,
+                                              bytes, mode);
+    if (!mapping || mapping->size() < bytes) {
+        delete mapping;
+        return Array<D,Tp>();
+    }
+
+    Array<0,Tp> *storage;
+    if (NpyType<Tp>::kind == header.kind &&
+        int(sizeof(Tp)) == header.itemSize &&
+        header.bigEndian == npyHostIsBigEndian() &&
+        quintptr(mapping->data()) % alignof(Tp) == 0)
+    {
+        storage = new Array<0,Tp>(rows, cols, (Tp*) mapping->data(),
+                                  mapping, mode == ArrayMapping::ReadOnly);
+    } else {
+        storage = new Array<0,Tp>(rows, cols);
+        bool ok = npyConvert(header, mapping->data(), storage->begin(), size);
+        delete mapping;
+        if (!ok) {
+            delete storage;
+            return Array<D,Tp>();
+        }
+    }
+    if (D == 2 && header.fortranOrder) {
+        storage->setLayout(ColumnMajor);
+    }
+    return Array<D,Tp>(storage);
+}
+
+
+/*********************************************
+ * Reading and writing of NumPy files, e.g.
+ *   auto X = loadNpy<2>("features.npy");
+ *   auto y = loadNpz<1,float>("run.npz", "y");
+ * Arrays of any shape load as Array<1> (the
+ * elements in file order) and as Array<2>
+ * (the first axis gives the rows). Fortran
+ * ordered files give column major matrices.
+ * Failures give empty arrays.
+ *********************************************/
+
+template <int D, typename Tp=double> inline
+Array<D,Tp> loadNpy(const QString &filePath,
+                    ArrayMapping::Mode mode=ArrayMapping::ReadOnly)
+{
+    NpyHeader header;
+    if (!NpyHeader::read(filePath, 0, header)) {
+        return Array<D,Tp>();
+    }
+    return npyLoad<D,Tp>(filePath, header, mode);
+}
+
+
+template <int D, typename Tp=double> inline
+Array<D,Tp> loadNpz(const QString &filePath, const QString &name,
+                    ArrayMapping::Mode mode=ArrayMapping::ReadOnly)
+{
+    NpyHeader header;
+    if (!NpyHeader::readNpz(filePath, name, header)) {
+        return Array<D,Tp>();
+    }
+    return npyLoad<D,Tp>(filePath, header, mode);
+}
+
+
+KSL_EXPORT bool npyWrite(const QString &filePath, const QByteArray &header,
+                         const char *data, qint64 bytes);
+
+
+template <typename Tp> inline
+QByteArray npyHeader(const Array<1,Tp> &array) {
+    static_assert(NpyType<Tp>::isValid, "Element type has no NumPy dtype");
+    return NpyHeader::make(NpyType<Tp>::kind, sizeof(Tp), false,
+                           QVector<Index>() << array.size());
+}
+
+
+template <typename Tp> inline
+QByteArray npyHeader(const Array<2,Tp> &array) {
+    static_assert(NpyType<Tp>::isValid, "Element type has no NumPy dtype");
+    return NpyHeader::make(NpyType<Tp>::kind, sizeof(Tp),
+                           array.layout() == ColumnMajor,
+                           QVector<Index>() << array.rows() << array.cols());
+}
+
+
+template <int D, typename Tp> inline
+bool saveNpy(const QString &filePath, const Array<D,Tp> &array) {
+    return npyWrite(filePath, npyHeader(array),
+                    (const char*) array.begin(),
+                    qint64(array.size())*qint64(sizeof(Tp)));
+}
+
+
+/*********************************************
+ * Writes arrays to an uncompressed .npz file,
+ * readable by numpy.load():
+ *   NpzWriter npz("run.npz");
+ *   npz.add("x", x);
+ *   npz.add("m", m);
+ * The file is finished by close() or by the
+ * destructor.
+ *********************************************/
+class KSL_EXPORT NpzWriter
+    : public Ksl::Object
+{
+public:
+
+    NpzWriter(const QString &filePath);
+
+    ~NpzWriter();
+
+    bool isOpen() const;
+
+    template <int D, typename Tp>
+    bool add(const QString &name, const Array<D,Tp> &array) {
+        return addEntry(name, npyHeader(array),
+                        (const char*) array.begin(),
+                        qint64(array.size())*qint64(sizeof(Tp)));
+    }
+
+    bool close();
+
+
+private:
+
+    bool addEntry(const QString &name, const QByteArray &header,
+                  const char *data, qint64 bytes);
+};
+
+} // namespace Ksl
+
+#endif // KSL_NPY_H
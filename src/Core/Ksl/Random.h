@@ -0,0 +1,294 @@
+/*
+ * Copyright (C) 2016  Elvis Teixeira
+ *
+ * This source code is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General
+ * Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This source code is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef KSL_RANDOM_H
+#define KSL_RANDOM_H
+
+#include <Ksl/Math.h>
+#include <QtGlobal>
+#include <atomic>
+
+namespace Ksl {
+
+/*********************************************
+ * Fast pseudo random generator, xoshiro256**
+ * run as four interleaved lanes so the bulk
+ * fills vectorize. The sequence depends only
+ * on the seed, on every platform.
+ *
+ * Independent streams for threads are made
+ * with Random(seed, stream), whose state is a
+ * hash of both, or taken from local(), a
+ * generator per thread. Use jump() on copies
+ * of one generator for streams that provably
+ * don't overlap.
+ *
+ * It is a UniformRandomBitGenerator, so it can
+ * also drive the <random> distributions.
+ *********************************************/
+class Random
+{
+public:
+
+    typedef quint64 result_type;
+
+    static const int Lanes = 4;
+
+    explicit Random(quint64 seed=0x853c49e6748fea9bull, quint64 stream=0) {
+        this->seed(seed, stream);
+    }
+
+    void seed(quint64 seed, quint64 stream=0);
+
+    static constexpr quint64 min() { return 0; }
+    static constexpr quint64 max() { return ~quint64(0); }
+
+    quint64 operator() () { return next(); }
+
+    quint64 next() {
+        if (m_next == Lanes) {
+            step(m_buffer);
+            m_next = 0;
+        }
+        return m_buffer[m_next++];
+    }
+
+    // In [0,1), with 53 random bits
+    double uniform() { return toUnit(next()); }
+
+    double uniform(double a, double b) { return a + (b-a)*uniform(); }
+
+    // Index in [0,n), e.g. for bootstrap resampling
+    Index below(Index n) { return Index(uniform()*double(n)); }
+
+    double normal(double mean=0.0, double sigma=1.0);
+
+    double exponential(double lambda=1.0) {
+        return -std::log1p(-uniform())/lambda;
+    }
+
+    void fill(quint64 *dest, Index size);
+
+    void fillUniform(double *dest, Index size, double a=0.0, double b=1.0);
+
+    void fillNormal(double *dest, Index size, double mean=0.0, double sigma=1.0);
+
+    void fillExponential(double *dest, Index size, double lambda=1.0);
+
+    // Advance 2^128 steps, for 2^128 non-overlapping streams
+    void jump();
+
+    // Advance 2^192 steps, to split streams among machines
+    void longJump();
+
+    // The generator of the calling thread, each thread
+    // gets its own stream of the default seed
+    static Random& local();
+
+
+private:
+
+    static quint64 rotl(quint64 x, int k) {
+        return (x << k) | (x >> (64 - k));
+    }
+
+    static double toUnit(quint64 x) {
+        return double(x >> 11) * (1.0/9007199254740992.0);
+    }
+
+    // One output per lane, the loop over lanes vectorizes
+    void step(quint64 *out) {
+        for (int l=0; l<Lanes; ++l) {
+            quint64 s0 = m_s[0][l], s1 = m_s[1][l];
+            quint64 s2 = m_s[2][l], s3 = m_s[3][l];
+            out[l] = rotl(s1*5, 7)*9;
+            quint64 t = s1 << 17;
+            s2 ^= s0;
+            s3 ^= s1;
+            s1 ^= s2;
+            s0 ^= s3;
+            s2 ^= t;
+            s3 = rotl(s3, 45);
+            m_s[0][l] = s0; m_s[1][l] = s1;
+            m_s[2][l] = s2; m_s[3][l] = s3;
+        }
+    }
+
+    void jump(const quint64 *poly);
+
+    // Converts raw numbers, in place, in chunks
+    template <typename F> void fillWith(double *dest, Index size, F func);
+
+    quint64 m_s[4][Lanes];
+    quint64 m_buffer[Lanes];
+    int m_next;
+    bool m_hasSpare;
+    double m_spare;
+};
+
+
+inline void Random::seed(quint64 seed, quint64 stream) {
+    // Other streams start from a hash of the stream,
+    // in O(1), stream 0 is the seed alone
+    if (stream != 0) {
+        quint64 z = stream ^ 0xd1b54a32d192ed03ull;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        seed ^= z ^ (z >> 31);
+    }
+    // SplitMix64 spreads the seed over the whole state
+    for (int w=0; w<4; ++w) {
+        for (int l=0; l<Lanes; ++l) {
+            seed += 0x9e3779b97f4a7c15ull;
+            quint64 z = seed;
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+            m_s[w][l] = z ^ (z >> 31);
+        }
+    }
+    m_next = Lanes;
+    m_hasSpare = false;
+}
+
+
+inline void Random::jump(const quint64 *poly) {
+    quint64 s[4][Lanes] = { { 0 } };
+    quint64 out[Lanes];
+    for (int i=0; i<4; ++i) {
+        for (int b=0; b<64; ++b) {
+            if (poly[i] & (quint64(1) << b)) {
+                for (int w=0; w<4; ++w) {
+                    for (int l=0; l<Lanes; ++l) {
+                        s[w][l] ^= m_s[w][l];
+                    }
+                }
+            }
+            step(out);
+        }
+    }
+    for (int w=0; w<4; ++w) {
+        for (int l=0; l<Lanes; ++l) {
+            m_s[w][l] = s[w][l];
+        }
+    }
+    m_next = Lanes;
+    m_hasSpare = false;
+}
+
+
+inline void Random::jump() {
+    static const quint64 poly[4] = {
+        0x180ec6d33cfd0abaull, 0xd5a61266f0c9392cull,
+        0xa9582618e03fc9aaull, 0x39abdc4529b1661cull
+    };
+    jump(poly);
+}
+
+
+inline void Random::longJump() {
+    static const quint64 poly[4] = {
+        0x76e15d3efefdcbbfull, 0xc5004e441c522fb3ull,
+        0x77710069854ee241ull, 0x39109bb02acbe635ull
+    };
+    jump(poly);
+}
+
+
+inline void Random::fill(quint64 *dest, Index size) {
+    Index k = 0;
+    while (k < size && m_next < Lanes) {
+        dest[k++] = m_buffer[m_next++];
+    }
+    for (; k+Lanes<=size; k+=Lanes) {
+        step(dest + k);
+    }
+    while (k < size) {
+        dest[k++] = next();
+    }
+}
+
+
+template <typename F>
+void Random::fillWith(double *dest, Index size, F func) {
+    const Index chunk = 256;
+    quint64 raw[chunk];
+    for (Index k=0; k<size; k+=chunk) {
+        Index n = (size - k < chunk) ? size - k : chunk;
+        fill(raw, n);
+        for (Index i=0; i<n; ++i) {
+            dest[k+i] = func(raw[i]);
+        }
+    }
+}
+
+
+inline void Random::fillUniform(double *dest, Index size, double a, double b) {
+    double scale = b - a;
+    fillWith(dest, size, [a,scale](quint64 x) {
+        return a + scale*toUnit(x);
+    });
+}
+
+
+inline void Random::fillExponential(double *dest, Index size, double lambda) {
+    fillWith(dest, size, [lambda](quint64 x) {
+        return -std::log1p(-toUnit(x))/lambda;
+    });
+}
+
+
+inline double Random::normal(double mean, double sigma) {
+    if (m_hasSpare) {
+        m_hasSpare = false;
+        return mean + sigma*m_spare;
+    }
+    // Box-Muller, 1-u is in (0,1] and has a finite log
+    double r = std::sqrt(-2.0*std::log(1.0 - uniform()));
+    double theta = 2.0*M_PI*uniform();
+    m_spare = r*std::sin(theta);
+    m_hasSpare = true;
+    return mean + sigma*r*std::cos(theta);
+}
+
+
+inline void Random::fillNormal(double *dest, Index size, double mean, double sigma) {
+    // Uniform pairs first, then Box-Muller over the whole chunk
+    fillUniform(dest, size & ~Index(1));
+    for (Index k=0; k+1<size; k+=2) {
+        double r = std::sqrt(-2.0*std::log(1.0 - dest[k]));
+        double theta = 2.0*M_PI*dest[k+1];
+        dest[k] = mean + sigma*r*std::cos(theta);
+        dest[k+1] = mean + sigma*r*std::sin(theta);
+    }
+    if (size & 1) {
+        dest[size-1] = normal(mean, sigma);
+    }
+}
+
+
+inline Random& Random::local() {
+    static std::atomic<quint64> streams(0);
+    static thread_local Random generator(0x853c49e6748fea9bull, streams++);
+    return generator;
+}
+
+} // namespace Ksl
+
+#endif // KSL_RANDOM_H
@@ -0,0 +1,316 @@
+/*
+ * Copyright (C) 2016  Elvis Teixeira
+ *
+ * This source code is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General
+ * Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This source code is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <Ksl/ThreadPool_p.h>
+#include <algorithm>
+#include <cstdlib>
+#include <exception>
+
+namespace Ksl {
+
+namespace {
+
+// The pool and queue of the current worker thread
+thread_local ThreadPoolPrivate *currentPool = nullptr;
+thread_local int currentQueue = 0;
+
+// The pool whose workers this thread is using from outside
+thread_local ThreadPoolPrivate *usedPool = nullptr;
+
+
+// Ranges of a parallelFor, claimed one at a time by the
+// caller and the helpers, so fast threads take more
+struct RangeJob
+{
+    RangeJob(const std::function<void(Index,Index)> &func,
+             Index size, Index chunk)
+        : func(func), size(size), chunk(chunk)
+        , chunks((size + chunk - 1)/chunk)
+        , next(0), done(0)
+    { }
+
+    void work() {
+        Index k;
+        while ((k = next.fetch_add(1)) < chunks) {
+            Index begin = k*chunk;
+            try {
+                func(begin, std::min(begin + chunk, size));
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+            if (done.fetch_add(1) + 1 == chunks) {
+                std::lock_guard<std::mutex> lock(mutex);
+                finished.notify_all();
+            }
+        }
+    }
+
+    // Helpers may start after the caller returned,
+    // they find no ranges left and never call it
+    const std::function<void(Index,Index)> &func;
+    Index size;
+    Index chunk;
+    Index chunks;
+    std::atomic<Index> next;
+    std::atomic<Index> done;
+    std::mutex mutex;
+    std::condition_variable finished;
+    std::exception_ptr error;
+};
+
+
+// Marks a caller from outside the pool as using the
+// workers, so that setThreadCount() does not replace
+// them meanwhile. Workers are already inside a task
+// and are waited for by stopWorkers(), and nested
+// calls are covered by the outer one
+class PoolUse
+{
+public:
+
+    PoolUse(ThreadPoolPrivate *pool)
+        : m_pool((currentPool == pool || usedPool == pool) ? nullptr : pool)
+        , m_previous(usedPool)
+    {
+        if (m_pool) {
+            std::unique_lock<std::mutex> lock(m_pool->mutex);
+            m_pool->idle.wait(lock, [this]() { return !m_pool->resizing; });
+            m_pool->users += 1;
+            usedPool = m_pool;
+        }
+    }
+
+    ~PoolUse() {
+        if (m_pool) {
+            usedPool = m_previous;
+            std::lock_guard<std::mutex> lock(m_pool->mutex);
+            m_pool->users -= 1;
+            if (m_pool->users == 0) {
+                m_pool->idle.notify_all();
+            }
+        }
+    }
+
+
+private:
+
+    PoolUse(const PoolUse&);
+    PoolUse& operator= (const PoolUse&);
+
+    ThreadPoolPrivate *m_pool;
+    ThreadPoolPrivate *m_previous;
+};
+
+} // namespace
+
+
+ThreadPool::ThreadPool(int threads)
+    : Ksl::Object(new ThreadPoolPrivate(this))
+{
+    startWorkers(threads);
+}
+
+
+ThreadPool::~ThreadPool() {
+    stopWorkers();
+}
+
+
+int ThreadPool::threadCount() const {
+    KSL_PUBLIC(const ThreadPool);
+    return m->threads.load();
+}
+
+
+void ThreadPool::setThreadCount(int threads) {
+    KSL_PUBLIC(ThreadPool);
+    Q_ASSERT(currentPool != m && usedPool != m);
+    {
+        // one resize at a time, after the current users
+        std::unique_lock<std::mutex> lock(m->mutex);
+        m->idle.wait(lock, [m]() { return !m->resizing; });
+        m->resizing = true;
+        m->idle.wait(lock, [m]() { return m->users == 0; });
+    }
+    stopWorkers();
+    startWorkers(threads);
+    {
+        std::lock_guard<std::mutex> lock(m->mutex);
+        m->resizing = false;
+    }
+    m->idle.notify_all();
+}
+
+
+void ThreadPool::startWorkers(int threads) {
+    KSL_PUBLIC(ThreadPool);
+    if (threads <= 0) {
+        threads = std::max(int(std::thread::hardware_concurrency()), 1);
+    }
+    for (int k=0; k<threads-1; ++k) {
+        m->queues.push_back(std::unique_ptr<ThreadPoolPrivate::Queue>(
+                                new ThreadPoolPrivate::Queue));
+    }
+    for (int k=0; k<threads-1; ++k) {
+        m->workers.push_back(std::thread(&ThreadPool::workerLoop, this, k));
+    }
+    m->threads = threads;
+}
+
+
+void ThreadPool::stopWorkers() {
+    KSL_PUBLIC(ThreadPool);
+    {
+        std::lock_guard<std::mutex> lock(m->mutex);
+        m->stop = true;
+    }
+    m->wake.notify_all();
+    for (auto &worker : m->workers) {
+        worker.join();
+    }
+    m->workers.clear();
+    m->queues.clear();
+    m->threads = 1;
+    m->stop = false;
+}
+
+
+void ThreadPool::workerLoop(int index) {
+    KSL_PUBLIC(ThreadPool);
+    currentPool = m;
+    currentQueue = index;
+    std::function<void()> task;
+    for (;;) {
+        if (takeTask(index, task)) {
+            task();
+            task = nullptr;
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(m->mutex);
+        m->wake.wait(lock, [m]() { return m->stop || m->pending > 0; });
+        if (m->stop && m->pending == 0) {
+            break;
+        }
+    }
+    currentPool = nullptr;
+}
+
+
+bool ThreadPool::takeTask(int index, std::function<void()> &task) {
+    KSL_PUBLIC(ThreadPool);
+    int count = int(m->queues.size());
+    for (int k=0; k<count; ++k) {
+        ThreadPoolPrivate::Queue &queue = *m->queues[(index + k) % count];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) {
+            continue;
+        }
+        // The newest own task is the one still in cache,
+        // thieves take the oldest ones
+        if (k == 0) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        } else {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+        m->pending -= 1;
+        return true;
+    }
+    return false;
+}
+
+
+void ThreadPool::submit(const std::function<void()> &task) {
+    KSL_PUBLIC(ThreadPool);
+    PoolUse use(m);
+    queueTask(task);
+}
+
+
+void ThreadPool::queueTask(const std::function<void()> &task) {
+    KSL_PUBLIC(ThreadPool);
+    if (m->workers.empty()) {
+        task();
+        return;
+    }
+    // Workers queue their own tasks, other threads
+    // spread them over the workers
+    int index = (currentPool == m) ? currentQueue
+        : int(m->nextQueue.fetch_add(1) % m->queues.size());
+    {
+        ThreadPoolPrivate::Queue &queue = *m->queues[index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(task);
+    }
+    {
+        std::lock_guard<std::mutex> lock(m->mutex);
+        m->pending += 1;
+    }
+    m->wake.notify_one();
+}
+
+
+void ThreadPool::parallelFor(Index size, Index grain,
+                             const std::function<void(Index,Index)> &func)
+{
+    KSL_PUBLIC(ThreadPool);
+    if (size <= 0) {
+        return;
+    }
+    // A few ranges per thread balance uneven work
+    // without much scheduling overhead
+    Index threads = threadCount();
+    Index chunk = std::max(std::max(grain, Index(1)),
+                           (size + 4*threads - 1)/(4*threads));
+    if (threads < 2 || chunk >= size) {
+        func(0, size);
+        return;
+    }
+
+    PoolUse use(m);
+    auto job = std::make_shared<RangeJob>(func, size, chunk);
+    Index helpers = std::min(threads - 1, job->chunks - 1);
+    for (Index k=0; k<helpers; ++k) {
+        queueTask([job]() { job->work(); });
+    }
+    job->work();
+    {
+        std::unique_lock<std::mutex> lock(job->mutex);
+        job->finished.wait(lock, [&job]() { return job->done == job->chunks; });
+    }
+    if (job->error) {
+        std::rethrow_exception(job->error);
+    }
+}
+
+
+ThreadPool& ThreadPool::global() {
+    static ThreadPool pool([]() {
+        const char *threads = std::getenv("KSL_NUM_THREADS");
+        return threads ? std::atoi(threads) : 0;
+    }());
+    return pool;
+}
+
+} // namespace Ksl
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2016  Elvis Teixeira
+ *
+ * This source code is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General
+ * Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This source code is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef KSL_THREADPOOL_H
+#define KSL_THREADPOOL_H
+
+#include <Ksl/Object.h>
+#include <functional>
+
+// Smallest range of cheap elements worth sending
+// to another thread
+#ifndef KSL_PARALLEL_GRAIN
+#define KSL_PARALLEL_GRAIN 4096
+#endif
+
+namespace Ksl {
+
+/*********************************************
+ * Bounded pool of worker threads. Each worker
+ * has its own task queue and steals from the
+ * others when it runs dry. The array functions
+ * share the global() pool, whose size is taken
+ * from the KSL_NUM_THREADS environment variable
+ * or from the number of cores.
+ *********************************************/
+class KSL_EXPORT ThreadPool
+    : public Ksl::Object
+{
+public:
+
+    // Threads working on a parallelFor(), counting
+    // the caller. Zero or less means one per core
+    ThreadPool(int threads=0);
+
+    ~ThreadPool();
+
+    int threadCount() const;
+
+    // Waits for the running parallelFor() calls and
+    // the queued tasks, then restarts the workers. Use
+    // it to pin the number of threads. Calls from other
+    // threads wait meanwhile; it must not be called
+    // from a task running in this pool
+    void setThreadCount(int threads);
+
+    // Queues a task for the workers
+    void submit(const std::function<void()> &task);
+
+    // Calls func(begin, end) over ranges of at least
+    // grain elements covering [0, size), the caller
+    // taking part, and returns when all are done.
+    // An exception thrown by func is rethrown here
+    void parallelFor(Index size, Index grain,
+                     const std::function<void(Index,Index)> &func);
+
+    static ThreadPool& global();
+
+
+private:
+
+    void startWorkers(int threads);
+
+    void stopWorkers();
+
+    void workerLoop(int index);
+
+    bool takeTask(int index, std::function<void()> &task);
+
+    void queueTask(const std::function<void()> &task);
+};
+
+} // namespace Ksl
+
+#endif // KSL_THREADPOOL_H
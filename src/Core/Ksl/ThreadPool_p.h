@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2016  Elvis Teixeira
+ *
+ * This source code is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General
+ * Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This source code is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the public Ksl API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed. Do not include it
+//
+// We mean it.
+//
+
+#ifndef KSL_THREADPOOL_P_H
+#define KSL_THREADPOOL_P_H
+
+#include <Ksl/ThreadPool.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Ksl {
+
+class ThreadPoolPrivate
+    : public Ksl::ObjectPrivate
+{
+public:
+
+    ThreadPoolPrivate(ThreadPool *publ)
+        : Ksl::ObjectPrivate(publ)
+        , pending(0), nextQueue(0), threads(1)
+        , stop(false), users(0), resizing(false)
+    { }
+
+    // Task queue of a worker, the owner takes from
+    // the back and thieves from the front
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::atomic<Index> pending;
+    std::atomic<unsigned> nextQueue;
+    std::atomic<int> threads;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stop;
+
+    // Callers from outside the pool using the workers,
+    // setThreadCount() waits for them to leave
+    int users;
+    bool resizing;
+    std::condition_variable idle;
+};
+
+} // namespace Ksl
+
+#endif // KSL_THREADPOOL_P_H
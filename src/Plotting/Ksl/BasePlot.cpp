@@ -20,6 +20,7 @@
 
 #include <Ksl/BasePlot_p.h>
 #include <Ksl/FigureScale.h>
+#include <Ksl/ArrayReduce.h>
 #include <QtGui>
 
 namespace Ksl {
@@ -41,10 +42,27 @@ QRectF BasePlot::dataRect() const {
 }
 
 
+// x and y may be lines of the same matrix
+qint64 BasePlot::memoryUsage() const {
+    KSL_PUBLIC(const BasePlot);
+    qint64 bytes = 0;
+    if (m->x.storage()) {
+        bytes += m->x.storage()->memoryUsage();
+    }
+    if (m->y.storage() && m->y.storage() != m->x.storage()) {
+        bytes += m->y.storage()->memoryUsage();
+    }
+    return bytes;
+}
+
+
 void BasePlot::paint(QPainter *painter) {
     KSL_PUBLIC(BasePlot);
     if (m->pointCount == 0)
         return;
+    m->visibleRange(m->scale);
+    if (m->paintBegin >= m->paintEnd)
+        return;
 
     painter->setPen(m->pen);
     painter->setBrush(m->brush);
@@ -65,18 +83,33 @@ void BasePlot::paint(QPainter *painter) {
 
 
 void BasePlotPrivate::checkRanges() {
-    pointCount = qMin(x.size(), y.size());
+    pointCount = qMin(uniformX ? xRange.size() : x.size(), y.size());
     if (pointCount == 0) {
         return;
     }
-    xMin = xMax = x[0];
-    yMin = yMax = y[0];
-    for (int k=1; k<pointCount; ++k) {
-        if (x[k] < xMin) xMin = x[k];
-        if (x[k] > xMax) xMax = x[k];
-        if (y[k] < yMin) yMin = y[k];
-        if (y[k] > yMax) yMax = y[k];
+    if (uniformX) {
+        xMin = qMin(xRange[0], xRange[pointCount-1]);
+        xMax = qMax(xRange[0], xRange[pointCount-1]);
+    } else {
+        minmax(x.data(), pointCount, x.stride(), xMin, xMax);
+    }
+    minmax(y.data(), pointCount, y.stride(), yMin, yMax);
+}
+
+
+void BasePlotPrivate::visibleRange(FigureScale *scale) {
+    paintBegin = 0;
+    paintEnd = pointCount;
+    if (!uniformX || xRange.step() == 0.0) {
+        return;
     }
+    // With a uniform x the samples inside the figure are found
+    // in O(1), one more on each side draws the border crossings
+    QRect rect = scale->figureRect();
+    Index k1 = xRange.indexAt(scale->unmap(rect.topLeft()).x());
+    Index k2 = xRange.indexAt(scale->unmap(rect.bottomRight()).x());
+    paintBegin = qBound(Index(0), qMin(k1, k2) - 1, pointCount);
+    paintEnd = qBound(Index(0), qMax(k1, k2) + 2, pointCount);
 }
 
 
@@ -85,11 +118,11 @@ void BasePlotPrivate::paintLine(FigureScale *scale,
 {
     QPainterPath path;
 
-    QPoint p1 = scale->map(QPointF(x[0], y[0]));
+    QPoint p1 = scale->map(QPointF(xAt(paintBegin), y[paintBegin]));
     path.moveTo(p1);
 
-    for (int k=1; k<pointCount; ++k) {
-        QPoint p2 = scale->map(QPointF(x[k], y[k]));
+    for (Index k=paintBegin+1; k<paintEnd; ++k) {
+        QPoint p2 = scale->map(QPointF(xAt(k), y[k]));
 
         int dx = p2.x() - p1.x();
         int dy = p2.y() - p1.y();
@@ -110,8 +143,8 @@ void BasePlotPrivate::paintCircles(FigureScale *scale,
     const float rad = symbolRadius;
     const float twoRad = 2.0 * symbolRadius;
 
-    for (int k=0; k<pointCount; ++k) {
-        QPoint p = scale->map(QPointF(x[k], y[k]));
+    for (Index k=paintBegin; k<paintEnd; ++k) {
+        QPoint p = scale->map(QPointF(xAt(k), y[k]));
         painter->drawEllipse(p.x() - rad, p.y() - rad, twoRad, twoRad);
     }
 }
@@ -123,10 +156,10 @@ void BasePlotPrivate::paintLineCircles(FigureScale *scale,
     const float rad = symbolRadius;
     const float twoRad = 2.0 * symbolRadius;
 
-    QPoint p1 = scale->map(QPointF(x[0], y[0]));
+    QPoint p1 = scale->map(QPointF(xAt(paintBegin), y[paintBegin]));
 
-    for (int k=1; k<pointCount; ++k) {
-        QPoint p2 = scale->map(QPointF(x[k], y[k]));
+    for (Index k=paintBegin+1; k<paintEnd; ++k) {
+        QPoint p2 = scale->map(QPointF(xAt(k), y[k]));
 
         int dx = p2.x() - p1.x();
         int dy = p2.y() - p1.y();
@@ -139,7 +172,7 @@ void BasePlotPrivate::paintLineCircles(FigureScale *scale,
         }
     }
 
-    p1 = scale->map(QPointF(x[pointCount-1], y[pointCount-1]));
+    p1 = scale->map(QPointF(xAt(paintEnd-1), y[paintEnd-1]));
     painter->drawEllipse(p1.x() - rad, p1.y() - rad, twoRad, twoRad);
 }
 
@@ -150,8 +183,8 @@ void BasePlotPrivate::paintSquares(FigureScale *scale,
     const float edge = symbolRadius - 1.0;
     const float halfEdge = edge / 2.0;
 
-    for (int k=1; k<pointCount; ++k) {
-        QPoint p = scale->map(QPointF(x[k], y[k]));
+    for (Index k=paintBegin+1; k<paintEnd; ++k) {
+        QPoint p = scale->map(QPointF(xAt(k), y[k]));
         painter->drawRect(p.x()-halfEdge, p.y()-halfEdge, edge, edge);
     }
 }
@@ -163,10 +196,10 @@ void BasePlotPrivate::paintLineSquares(FigureScale *scale,
     const float edge = symbolRadius - 1.0;
     const float halfEdge = edge / 2.0;
 
-    QPoint p1 = scale->map(QPointF(x[0], y[0]));
+    QPoint p1 = scale->map(QPointF(xAt(paintBegin), y[paintBegin]));
 
-    for (int k=1; k<pointCount; ++k) {
-        QPoint p2 = scale->map(QPointF(x[k], y[k]));
+    for (Index k=paintBegin+1; k<paintEnd; ++k) {
+        QPoint p2 = scale->map(QPointF(xAt(k), y[k]));
 
         int dx = p2.x() - p1.x();
         int dy = p2.y() - p1.y();
@@ -178,7 +211,7 @@ void BasePlotPrivate::paintLineSquares(FigureScale *scale,
             p1 = p2;
         }
     }
-    p1 = scale->map(QPointF(x[pointCount-1], y[pointCount-1]));
+    p1 = scale->map(QPointF(xAt(paintEnd-1), y[paintEnd-1]));
     painter->drawEllipse(p1.x()-halfEdge, p1.y()-halfEdge, edge, edge);
 }
 
@@ -46,6 +46,8 @@ public:
 
     virtual QRectF dataRect() const;
 
+    virtual qint64 memoryUsage() const;
+
     QPen pen() const;
 
     QBrush brush() const;
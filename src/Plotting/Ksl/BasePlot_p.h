@@ -47,10 +47,15 @@ public:
         , symbol(BasePlot::Line)
         , antialias(false)
         , symbolRadius(3.0)
+        , uniformX(false)
+        , pointCount(0)
+        , paintBegin(0)
+        , paintEnd(0)
     { }
 
 
     void checkRanges();
+    void visibleRange(FigureScale *scale);
     void paintLine(FigureScale *scale, QPainter *painter);
     void paintCircles(FigureScale *scale, QPainter *painter);
     void paintLineCircles(FigureScale *scale, QPainter *painter);
@@ -59,6 +64,10 @@ public:
     void paintTriangles(FigureScale *scale, QPainter *painter);
     void paintLineTriangles(FigureScale *scale, QPainter *painter);
 
+    double xAt(Index k) const {
+        return uniformX ? xRange[k] : x[k];
+    }
+
 
     BasePlot::Symbol symbol;
     bool antialias;
@@ -67,7 +76,12 @@ public:
     QBrush brush;
 
     ArrayView<double> x, y;
-    int pointCount;
+    // A uniform x axis is kept as a range, without storage
+    bool uniformX;
+    ArrayRange<double> xRange;
+    Index pointCount;
+    // Points drawn by the paint functions
+    Index paintBegin, paintEnd;
     double xMin, xMax;
     double yMin, yMax;
 };
@@ -118,12 +118,24 @@ Plot* Chart::plot(const ArrayView<double> &x,
 }
 
 
+Plot* Chart::plot(const ArrayRange<double> &x,
+                  const ArrayView<double> &y,
+                  const char *style,
+                  const QString &name,
+                  const QString &scaleName)
+{
+    auto newPlot = new Plot(x, y, style, name, this);
+    scale(scaleName)->add(newPlot);
+    return newPlot;
+}
+
+
 Plot* Chart::plot(const Array<1> &y,
                   const char *style,
                   const QString &name,
                   const QString &scaleName)
 {
-    auto x = arange(0.0, double(y.size()));
+    ArrayRange<double> x(0.0, 1.0, y.size());
     auto newPlot = new Plot(x, y, style, name, this);
     scale(scaleName)->add(newPlot);
     return newPlot;
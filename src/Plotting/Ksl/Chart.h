@@ -54,6 +54,12 @@ public:
                const QString &name="",
                const QString &scaleName="xy-scale");
 
+    Plot* plot(const ArrayRange<double> &x, const ArrayView<double> &y,
+               const char *style="kor",
+               const QString &name="",
+               const QString &scaleName="xy-scale");
+
+    // Plots y against the sample indexes
     Plot* plot(const Array<1> &y,
                const char *style="kor",
                const QString &name="",
@@ -21,6 +21,8 @@
 #include <Ksl/Figure_p.h>
 #include <Ksl/FigureScale.h>
 #include <Ksl/FigureLegend.h>
+#include <Ksl/FigureItem.h>
+#include <Ksl/MemoryStats.h>
 
 namespace Ksl {
 
@@ -108,6 +110,42 @@ FigureItem* Figure::item(const QString &name) const {
     return nullptr;
 }
 
+
+qint64 Figure::memoryUsage() const {
+    KSL_PUBLIC(const Figure);
+    qint64 bytes = 0;
+    for (auto scale : m->scaleList) {
+        for (auto item : scale->itemList()) {
+            bytes += item->memoryUsage();
+        }
+    }
+    return bytes;
+}
+
+
+QString Figure::memoryReport() const {
+    KSL_PUBLIC(const Figure);
+    QString items;
+    for (auto scale : m->scaleList) {
+        for (auto item : scale->itemList()) {
+            if (!items.isEmpty()) {
+                items += ", ";
+            }
+            items += QString("{\"name\": %1, \"type\": %2, "
+                             "\"scale\": %3, \"bytes\": %4}")
+                .arg(MemoryStats::jsonString(item->name()))
+                .arg(MemoryStats::jsonString(item->metaObject()->className()))
+                .arg(MemoryStats::jsonString(scale->name()))
+                .arg(item->memoryUsage());
+        }
+    }
+    return QString("{\"figure\": %1, \"bytes\": %2, \"items\": [%3]}")
+        .arg(MemoryStats::jsonString(m->name))
+        .arg(memoryUsage())
+        .arg(items);
+}
+
+
 void Figure::paint(const QRect &rect, QPainter *painter) {
     KSL_PUBLIC(Figure);
 
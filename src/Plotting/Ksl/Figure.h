@@ -64,6 +64,12 @@ public:
 
     FigureItem* item(const QString &name) const;
 
+    // Bytes of the data kept alive by the items
+    qint64 memoryUsage() const;
+
+    // JSON object with the memory used by each item
+    QString memoryReport() const;
+
     virtual void paint(const QRect &rect, QPainter *painter);
 
 
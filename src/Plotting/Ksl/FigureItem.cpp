@@ -121,6 +121,11 @@ bool FigureItem::selected() const {
 }
 
 
+qint64 FigureItem::memoryUsage() const {
+    return 0;
+}
+
+
 void FigureItem::setSelected(bool selected) {
     KSL_PUBLIC(FigureItem);
     if (m->selected != selected) {
@@ -59,6 +59,9 @@ public:
 
     bool selected() const;
 
+    // Bytes of the data kept alive by the item
+    virtual qint64 memoryUsage() const;
+
 
 public slots:
 
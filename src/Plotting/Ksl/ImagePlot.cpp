@@ -50,5 +50,22 @@ ImagePlot::ImagePlot(const ArrayView<quint32> &x,
 }
 
 
+qint64 ImagePlot::memoryUsage() const {
+    KSL_PUBLIC(const ImagePlot);
+    const Array<0,quint32> *storages[3] = {
+        m->data.storage(), m->x.storage(), m->y.storage()
+    };
+    qint64 bytes = 0;
+    for (int k=0; k<3; ++k) {
+        if (storages[k] && storages[k] != storages[(k+1)%3] &&
+            storages[k] != storages[(k+2)%3])
+        {
+            bytes += storages[k]->memoryUsage();
+        }
+    }
+    return bytes;
+}
+
+
 
 } // namespace Ksl
@@ -50,6 +50,7 @@ public:
               const QString &name="imagePlot",
               QObject *parent=0);
 
+    virtual qint64 memoryUsage() const;
 };
 
 } // namespace Ksl
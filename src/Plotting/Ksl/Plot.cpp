@@ -32,10 +32,33 @@ Plot::Plot(const ArrayView<double> &x, const ArrayView<double> &y,
 }
 
 
+Plot::Plot(const ArrayRange<double> &x, const ArrayView<double> &y,
+           const char *style, const QString &name,
+           QObject *parent)
+    : BasePlot(new PlotPrivate(this), name, parent)
+{
+    setData(x, y);
+    setStyle(style);
+}
+
+
 void Plot::setData(const ArrayView<double> &x, const ArrayView<double> &y) {
     KSL_PUBLIC(Plot);
     m->x = x;
     m->y = y;
+    m->uniformX = false;
+    m->xRange = ArrayRange<double>();
+    m->checkRanges();
+    emit dataChanged(this);
+}
+
+
+void Plot::setData(const ArrayRange<double> &x, const ArrayView<double> &y) {
+    KSL_PUBLIC(Plot);
+    m->x = ArrayView<double>();
+    m->y = y;
+    m->uniformX = true;
+    m->xRange = x;
     m->checkRanges();
     emit dataChanged(this);
 }
@@ -36,8 +36,15 @@ public:
          const char *style="kor", const QString &name="",
          QObject *parent=0);
 
+    // Samples at uniform x, e.g. ArrayRange<double>(t0, dt, y.size())
+    Plot(const ArrayRange<double> &x, const ArrayView<double> &y,
+         const char *style="kor", const QString &name="",
+         QObject *parent=0);
+
 
     virtual void setData(const ArrayView<double> &x, const ArrayView<double> &y);
+
+    virtual void setData(const ArrayRange<double> &x, const ArrayView<double> &y);
 };
 
 } // namespace Ksl
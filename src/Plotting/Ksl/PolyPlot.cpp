@@ -20,6 +20,8 @@
 
 #include <Ksl/PolyPlot_p.h>
 #include <Ksl/FigureScale.h>
+#include <Ksl/ArrayReduce.h>
+#include <Ksl/ArrayApply.h>
 
 namespace Ksl {
 
@@ -31,7 +33,7 @@ PolyPlot::PolyPlot(const Array<1> &a,
     : BasePlot(new PolyPlotPrivate(this), name, parent)
 {
     KSL_PUBLIC(PolyPlot);
-    m->a = copy(a);
+    m->a = a;
     m->xMin = xMin;
     m->xMax = xMax;
     setStyle(style);
@@ -39,9 +41,19 @@ PolyPlot::PolyPlot(const Array<1> &a,
 }
 
 
+qint64 PolyPlot::memoryUsage() const {
+    KSL_PUBLIC(const PolyPlot);
+    qint64 bytes = BasePlot::memoryUsage();
+    if (m->a.storage()) {
+        bytes += m->a.storage()->memoryUsage();
+    }
+    return bytes;
+}
+
+
 void PolyPlot::setParametes(const Array<1> &a) {
     KSL_PUBLIC(PolyPlot);
-    m->a = copy(a);
+    m->a = a;
     m->updateData();
     emit appearenceChanged(this);
 }
@@ -60,23 +72,21 @@ void PolyPlotPrivate::updateData() {
     if (a.size() == 0 || xMin >= xMax)
         return;
 
-    // create arrays
-    double dx = (xMax-xMin)/pointCount;
-    x = linspace(xMin, xMax, dx);
-    y = zeros(x.size());
+    // the x axis is uniform, only y is stored
+    uniformX = true;
+    xRange = ArrayRange<double>::linspace(xMin, xMax, pointCount);
 
-    // calculate functional values
-    for (int k=0; k<pointCount; ++k) {
-        //y[k] = poly(a, x[k]);
-    }
+    // calculate functional values, the samples
+    // are charged to the plotting subsystem
+    MemoryStats::Scope memoryScope(MemoryStats::Plotting);
+    const Array<1> &coefs = a;
+    const ArrayRange<double> &range = xRange;
+    y = generate([&coefs,&range](Index k) { return poly(coefs, range[k]); },
+                 pointCount);
 
     // set data ranges
-    yMin = y[0];
-    yMax = y[0];
-    for (int k=1; k<pointCount; ++k) {
-        if (y[k] < yMin) yMin = y[k];
-        if (y[k] > yMax) yMax = y[k];
-    }
+    if (y.size() > 0)
+        minmax(y.data(), y.size(), y.stride(), yMin, yMax);
 }
 
 } // namespace Ksl
@@ -39,6 +39,8 @@ public:
              const QString &name="poly",
              QObject *parent=0);
 
+    virtual qint64 memoryUsage() const;
+
 
 public slots:
 
@@ -28,15 +28,15 @@ LineRegr::LineRegr()
 { }
 
 
-LineRegr::LineRegr(const Array<1> &x, const Array<1> &y)
+LineRegr::LineRegr(const ArrayView<double> &x, const ArrayView<double> &y)
     : Ksl::Object(new LineRegrPrivate(this))
 {
     fit(x, y);
 }
 
 
-LineRegr::LineRegr(const Array<1> &x, const Array<1> &y,
-                   const Array<1> &w)
+LineRegr::LineRegr(const ArrayView<double> &x, const ArrayView<double> &y,
+                   const ArrayView<double> &w)
     : Ksl::Object(new LineRegrPrivate(this))
 {
     fit(x, y, w);
@@ -49,25 +49,27 @@ Array<1> LineRegr::result() const {
 }
 
 
-void LineRegr::fit(const Array<1> &x, const Array<1> &y) {
+void LineRegr::fit(const ArrayView<double> &x, const ArrayView<double> &y) {
     KSL_PUBLIC(LineRegr);
     m->x = x;
     m->y = y;
     gsl_fit_linear(
-        m->x.c_ptr(), 1, m->y.c_ptr(), 1, qMin(m->x.size(), m->y.size()),
+        m->x.data(), m->x.stride(), m->y.data(), m->y.stride(),
+        qMin(m->x.size(), m->y.size()),
         &m->result[0], &m->result[1], &m->result[2], &m->result[3],
         &m->result[4], &m->result[5]);
 }
 
 
-void LineRegr::fit(const Array<1> &x, const Array<1> &y,
-                   const Array<1> &w)
+void LineRegr::fit(const ArrayView<double> &x, const ArrayView<double> &y,
+                   const ArrayView<double> &w)
 {
     KSL_PUBLIC(LineRegr);
     m->x = x;
     m->y = y;
     gsl_fit_wlinear(
-        m->x.c_ptr(), 1, w.c_ptr(), 1, m->y.c_ptr(), 1, qMin(m->x.size(), m->y.size()),
+        m->x.data(), m->x.stride(), w.data(), w.stride(),
+        m->y.data(), m->y.stride(), qMin(m->x.size(), m->y.size()),
         &m->result[0], &m->result[1], &m->result[2], &m->result[3],
         &m->result[4], &m->result[5]);
 }
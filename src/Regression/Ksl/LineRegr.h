@@ -33,15 +33,15 @@ public:
 
     LineRegr();
 
-    LineRegr(const Array<1> &x, const Array<1> &y);
+    LineRegr(const ArrayView<double> &x, const ArrayView<double> &y);
 
-    LineRegr(const Array<1> &x, const Array<1> &y,
-             const Array<1> &w);
+    LineRegr(const ArrayView<double> &x, const ArrayView<double> &y,
+             const ArrayView<double> &w);
 
-    void fit(const Array<1> &x, const Array<1> &y);
+    void fit(const ArrayView<double> &x, const ArrayView<double> &y);
 
-    void fit(const Array<1> &x, const Array<1> &y,
-             const Array<1> &w);
+    void fit(const ArrayView<double> &x, const ArrayView<double> &y,
+             const ArrayView<double> &w);
 
     Array<1> result() const;
 };
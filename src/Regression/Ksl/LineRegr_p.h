@@ -48,8 +48,8 @@ public:
 
 
     Array<1> result;
-    Array<1> x;
-    Array<1> y;
+    ArrayView<double> x;
+    ArrayView<double> y;
 };
 
 } // namespace Ksl
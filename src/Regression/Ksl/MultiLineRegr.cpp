@@ -19,6 +19,7 @@
  */
 
 #include <Ksl/MultiLineRegr_p.h>
+#include <Ksl/ArrayProduct.h>
 
 namespace Ksl {
 
@@ -27,15 +28,17 @@ MultiLineRegr::MultiLineRegr()
 { }
 
 
-MultiLineRegr::MultiLineRegr(const Array<2> &X, const Array<1> &y)
+MultiLineRegr::MultiLineRegr(const ArrayBlock<double> &X,
+                             const ArrayView<double> &y)
     : Ksl::Object(new MultiLineRegrPrivate(this))
 {
     fit(X, y);
 }
 
 
-MultiLineRegr::MultiLineRegr(const Array<2> &X, const Array<1> &y,
-                             const Array<1> &w)
+MultiLineRegr::MultiLineRegr(const ArrayBlock<double> &X,
+                             const ArrayView<double> &y,
+                             const ArrayView<double> &w)
     : Ksl::Object(new MultiLineRegrPrivate(this))
 {
     fit(X, y, w);
@@ -43,7 +46,7 @@ MultiLineRegr::MultiLineRegr(const Array<2> &X, const Array<1> &y,
 
 
 MultiLineRegr::MultiLineRegr(const Csv &csv, const Array<1,int> &columns,
-                             const Array<1> &y)
+                             const ArrayView<double> &y)
     : Ksl::Object(new MultiLineRegrPrivate(this))
 {
     fit(csv, columns, y);
@@ -76,7 +79,7 @@ Array<2> MultiLineRegr::covariance() const {
 }
 
 
-void MultiLineRegr::fit(const Array<2> &X, const Array<1> &y)
+void MultiLineRegr::fit(const ArrayBlock<double> &X, const ArrayView<double> &y)
 {
     KSL_PUBLIC(MultiLineRegr);
     m->N = X.rows();
@@ -85,13 +88,17 @@ void MultiLineRegr::fit(const Array<2> &X, const Array<1> &y)
     if (m->workspace)
         gsl_multifit_linear_free(m->workspace);
     m->workspace = gsl_multifit_linear_alloc(m->N, m->P);
-    m->X = gsl_matrix_view_array((double*) X.c_ptr(), X.rows(), X.cols());
+    // GSL needs the elements of each row adjacent
+    m->data = (X.colStride() == 1) ? X : ArrayBlock<double>(copy(X));
+    m->X = gsl_matrix_view_array_with_tda((double*) m->data.data(),
+        m->data.rows(), m->data.cols(), m->data.rowStride());
     m->cov = Array<2>(m->P, m->P);
-    m->cov_view = gsl_matrix_view_array((double*) m->cov.c_ptr(), m->P, m->P);
+    m->cov_view = gsl_matrix_view_array(m->cov.begin(), m->P, m->P);
     m->y = y;
-    m->y_view = gsl_vector_view_array(m->y.c_ptr(), m->y.size());
+    m->y_view = gsl_vector_view_array_with_stride((double*) y.data(),
+        y.stride(), y.size());
     m->a = Array<1>(m->P);
-    m->a_view = gsl_vector_view_array(m->a.c_ptr(), m->a.size());
+    m->a_view = gsl_vector_view_array(m->a.begin(), m->a.size());
 
     gsl_multifit_linear(
         &m->X.matrix, &m->y_view.vector,
@@ -99,8 +106,9 @@ void MultiLineRegr::fit(const Array<2> &X, const Array<1> &y)
 }
 
 
-void MultiLineRegr::fit(const Array<2> &X, const Array<1> &y,
-                        const Array<1> &w)
+void MultiLineRegr::fit(const ArrayBlock<double> &X,
+                        const ArrayView<double> &y,
+                        const ArrayView<double> &w)
 {
     KSL_PUBLIC(MultiLineRegr);
     m->N = X.rows();
@@ -109,15 +117,20 @@ void MultiLineRegr::fit(const Array<2> &X, const Array<1> &y,
     if (m->workspace)
         gsl_multifit_linear_free(m->workspace);
     m->workspace = gsl_multifit_linear_alloc(m->N, m->P);
-    m->X = gsl_matrix_view_array((double*) X.c_ptr(), X.rows(), X.cols());
+    // GSL needs the elements of each row adjacent
+    m->data = (X.colStride() == 1) ? X : ArrayBlock<double>(copy(X));
+    m->X = gsl_matrix_view_array_with_tda((double*) m->data.data(),
+        m->data.rows(), m->data.cols(), m->data.rowStride());
     m->cov = Array<2>(m->P, m->P);
-    m->cov_view = gsl_matrix_view_array((double*) m->cov.c_ptr(), m->P, m->P);
+    m->cov_view = gsl_matrix_view_array(m->cov.begin(), m->P, m->P);
     m->y = y;
-    m->y_view = gsl_vector_view_array(m->y.c_ptr(), m->y.size());
+    m->y_view = gsl_vector_view_array_with_stride((double*) y.data(),
+        y.stride(), y.size());
     m->a = Array<1>(m->P);
-    m->a_view = gsl_vector_view_array(m->a.c_ptr(), m->a.size());
-    m->w = (w.size() == y.size()) ? w : Array<1>(m->N, 1.0);
-    m->w_view = gsl_vector_view_array(m->w.c_ptr(), m->w.size());
+    m->a_view = gsl_vector_view_array(m->a.begin(), m->a.size());
+    m->w = (w.size() == y.size()) ? w : ArrayView<double>(ones(m->N));
+    m->w_view = gsl_vector_view_array_with_stride((double*) m->w.data(),
+        m->w.stride(), m->w.size());
 
     gsl_multifit_wlinear(
         &m->X.matrix, &m->w_view.vector, &m->y_view.vector,
@@ -126,18 +139,22 @@ void MultiLineRegr::fit(const Array<2> &X, const Array<1> &y,
 
 
 void MultiLineRegr::fit(const Csv &csv, const Array<1,int> &columns,
-                        const Array<1> &y)
+                        const ArrayView<double> &y)
 {
 
     // File containing data
-    auto DATA = csv.matrix();
-    int N = DATA.rows();
+    const auto DATA = csv.matrix();
+    Index N = DATA.rows();
 
     // fill matrix with params
     Array<2> X(N, columns.size()+1);
-    X.set_col(0, 1.0);
-    for (int j=0; j<columns.size(); ++j) {
-        X.col_to_col(j+1, DATA, columns[j]);
+    double *x = X.begin();
+    for (Index k=0; k<N; ++k) {
+        double *row = x + k*X.cols();
+        row[0] = 1.0;
+        for (Index j=0; j<columns.size(); ++j) {
+            row[j+1] = DATA[k][columns[j]];
+        }
     }
 
     // Perform regression
@@ -148,15 +165,19 @@ void MultiLineRegr::fit(const Csv &csv, const Array<1,int> &columns,
 void MultiLineRegr::fit(const Csv &csv, const Array<1,int> &columns, int yCol)
 {
     // File containing data
-    auto DATA = csv.matrix();
-    int N = DATA.rows();
+    const auto DATA = csv.matrix();
+    Index N = DATA.rows();
     auto Y = col(DATA, yCol);
 
     // fill matrix with params
     Array<2> X(N, columns.size()+1);
-    X.set_col(0, 1.0);
-    for (int j=0; j<columns.size(); ++j) {
-        X.col_to_col(j+1, DATA, columns[j]);
+    double *x = X.begin();
+    for (Index k=0; k<N; ++k) {
+        double *row = x + k*X.cols();
+        row[0] = 1.0;
+        for (Index j=0; j<columns.size(); ++j) {
+            row[j+1] = DATA[k][columns[j]];
+        }
     }
 
     // Perform regression
@@ -164,13 +185,29 @@ void MultiLineRegr::fit(const Csv &csv, const Array<1,int> &columns, int yCol)
 }
 
 
-double MultiLineRegr::model(int idx) const {
+double MultiLineRegr::model(Index idx) const {
     KSL_PUBLIC(MultiLineRegr);
 
-    double yk = m->a[0];
-    for (int l=1; l<m->a.size(); l++)
-        yk += m->a[l] * gsl_matrix_get(&m->X.matrix, idx, l);
-    return yk;
+    // The first column of X holds the constant term
+    const double *row = gsl_matrix_const_ptr(&m->X.matrix, idx, 0);
+    return m->a[0] + dot(m->a.begin()+1, row+1, m->a.size()-1);
+}
+
+
+Array<1> MultiLineRegr::model() const {
+    KSL_PUBLIC(const MultiLineRegr);
+    return matvec(m->data, m->a);
+}
+
+
+Array<1> MultiLineRegr::predict(const ArrayBlock<double> &X) const {
+    KSL_PUBLIC(const MultiLineRegr);
+    if (X.cols() != m->a.size())
+        return Array<1>();
+
+    // X has the columns of the fitted design matrix,
+    // the first one holding the constant term
+    return matvec(X, m->a);
 }
 
 } // namespace Ksl
@@ -33,25 +33,33 @@ public:
 
     MultiLineRegr();
 
-    MultiLineRegr(const Array<2> &X, const Array<1> &y);
+    MultiLineRegr(const ArrayBlock<double> &X, const ArrayView<double> &y);
 
-    MultiLineRegr(const Array<2> &X, const Array<1> &y, const Array<1> &w);
+    MultiLineRegr(const ArrayBlock<double> &X, const ArrayView<double> &y,
+                  const ArrayView<double> &w);
 
-    MultiLineRegr(const Csv &csv, const Array<1,int> &columns, const Array<1> &y);
+    MultiLineRegr(const Csv &csv, const Array<1,int> &columns,
+                  const ArrayView<double> &y);
 
     MultiLineRegr(const Csv &csv, const Array<1,int> &columns, int yCol);
 
 
-    void fit(const Array<2> &X, const Array<1> &y);
+    void fit(const ArrayBlock<double> &X, const ArrayView<double> &y);
 
-    void fit(const Array<2> &X, const Array<1> &y, const Array<1> &w);
+    void fit(const ArrayBlock<double> &X, const ArrayView<double> &y,
+             const ArrayView<double> &w);
 
-    void fit(const Csv &csv, const Array<1,int> &columns, const Array<1> &y);
+    void fit(const Csv &csv, const Array<1,int> &columns,
+             const ArrayView<double> &y);
 
     void fit(const Csv &csv, const Array<1,int> &columns, int yCol);
 
 
-    double model(int idx) const;
+    double model(Index idx) const;
+
+    Array<1> model() const;
+
+    Array<1> predict(const ArrayBlock<double> &X) const;
 
     Array<1> result() const;
 
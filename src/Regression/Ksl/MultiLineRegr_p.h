@@ -59,8 +59,9 @@ public:
     size_t N, P;
 
     Array<1> a;
-    Array<1> y;
-    Array<1> w;
+    ArrayBlock<double> data;
+    ArrayView<double> y;
+    ArrayView<double> w;
     Array<2> cov;
     gsl_matrix_view X;
     gsl_matrix_view cov_view;
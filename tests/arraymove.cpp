@@ -0,0 +1,201 @@
+#include <Ksl/Array.h>
+#include <Ksl/MemoryPool.h>
+using namespace Ksl;
+
+#include <iostream>
+using namespace std;
+
+
+// Counts the buffers handed to arrays
+class CountingAllocator
+    : public AlignedAllocator
+{
+public:
+
+    void* allocate(std::size_t bytes) {
+        allocs += 1;
+        return AlignedAllocator::allocate(bytes);
+    }
+
+    void* reallocate(void *ptr, std::size_t oldBytes, std::size_t newBytes) {
+        allocs += 1;
+        return AlignedAllocator::reallocate(ptr, oldBytes, newBytes);
+    }
+
+    int allocs = 0;
+};
+
+
+static int failures = 0;
+
+static Array<1> makeRamp(Index size) {
+    return linspace(0.0, double(size - 1), size);
+}
+
+static void check(bool ok, const char *what) {
+    if (!ok) {
+        cout << "FAILED: " << what << endl;
+        failures += 1;
+    }
+}
+
+
+int main()
+{
+    CountingAllocator counter;
+    ArrayAllocator::setCurrent(&counter);
+
+    // creation helpers produce a single buffer
+    auto a = zeros(1000);
+    check(counter.allocs == 1, "zeros allocates once");
+    auto m = row_stack({ones(100), zeros(100)});
+    check(counter.allocs == 4, "row_stack allocates rows and result only");
+
+    // small arrays live inside their storage block
+    counter.allocs = 0;
+    Array<1> small(6, 1.0);
+    check(counter.allocs == 0, "small array does not allocate a buffer");
+    for (int k=0; k<6; ++k) {
+        small.append(double(k));
+    }
+    check(counter.allocs == 1, "small array spills to the heap on growth");
+    check(small.size() == 12 && small[11] == 5.0, "spilled array keeps its elements");
+
+    // moves steal the buffer
+    counter.allocs = 0;
+    const double *data = static_cast<const Array<1>&>(a).begin();
+    Array<1> b(std::move(a));
+    check(counter.allocs == 0, "move construction does not allocate");
+    check(b.storage()->refCount() == 1, "moved buffer is not shared");
+    check(static_cast<const Array<1>&>(b).begin() == data, "move keeps the buffer");
+    check(a.size() == 0, "moved from array is empty");
+    Array<1> c;
+    c = std::move(b);
+    check(counter.allocs == 0, "move assignment does not allocate");
+
+    // copies share until written
+    Array<1> d = c;
+    check(counter.allocs == 0, "copy shares the buffer");
+    d[0] = 1.0;
+    check(counter.allocs == 1, "write detaches a shared buffer");
+    check(c[0] == 0.0 && d[0] == 1.0, "write does not leak to the copy");
+    d[1] = 2.0;
+    check(counter.allocs == 1, "detached buffer is written in place");
+
+    // views keep the data they were given
+    ArrayView<double> view(c);
+    c[2] = 5.0;
+    check(view[2] == 0.0, "view is not changed by writes to the array");
+
+    // expression results are built in place
+    counter.allocs = 0;
+    Array<1> e = 2.0*d + 1.0;
+    check(counter.allocs == 1, "expression allocates only its result");
+    e = e*e;
+    check(counter.allocs == 1, "expression reuses an unshared buffer");
+
+    // outside buffers are wrapped, not copied
+    counter.allocs = 0;
+    int released = 0;
+    double *frame = new double[1000]();
+    {
+        Array<1> f(frame, 1000, [&released](double *p) {
+            delete[] p;
+            released += 1;
+        });
+        check(counter.allocs == 0, "wrapping does not allocate");
+        check(static_cast<const Array<1>&>(f).begin() == frame, "wrap keeps the buffer");
+        Array<1> g = f;
+        check(released == 0, "buffer lives while arrays use it");
+    }
+    check(released == 1, "last array releases the buffer");
+
+    // writes to a read only buffer go to a copy
+    released = 0;
+    {
+        const double *items = new double[3]{1.0, 2.0, 3.0};
+        Array<1> vec(const_cast<double*>(items), 3, [&released](double *p) {
+            delete[] p;
+            released += 1;
+        }, true);
+        Array<1> other = vec;
+        vec[1] = 5.0;
+        check(items[1] == 2.0 && vec[1] == 5.0, "write to a read only buffer copies it");
+        const Array<1> &view = other;
+        check(view[1] == 2.0 && view.begin() == items && released == 0,
+              "other arrays keep the read only buffer");
+        other.append(4.0);
+        check(released == 1 && other[3] == 4.0, "outgrown read only buffer is released");
+    }
+    Array<1> none(new double[1], 0, [&released](double *p) {
+        delete[] p;
+        released += 1;
+    });
+    check(none.size() == 0 && released == 2, "empty wrap releases the buffer at once");
+
+    // compound operations on a read only buffer read it
+    // while they write to a copy
+    released = 0;
+    {
+        auto release = [&released](double *p) {
+            delete[] p;
+            released += 1;
+        };
+        double *values = new double[4]{1.0, 2.0, 3.0, 4.0};
+        Array<2> mat(values, 2, 2, release, RowMajor, true);
+        mat *= mat;
+        check(mat(1,1) == 16.0 && mat(0,1) == 4.0, "self product of a read only matrix");
+        check(released == 1, "read only matrix released after the copy");
+        double *items = new double[3]{1.0, 2.0, 3.0};
+        Array<1> vec(items, 3, release, true);
+        vec += vec;
+        check(vec[2] == 6.0, "self sum of a read only vector");
+        vec += 2.0*vec;
+        check(vec[0] == 6.0, "read only vector expression");
+    }
+    check(released == 2, "read only buffers released once");
+
+    // arrays from before an arena keep their own allocator
+    {
+        MemoryPool pool;
+        Array<1> outer = linspace(0.0, 1.0, 100);
+        Array<1> shared = outer;
+        Array<1> result = zeros(100);
+        Array<1> other = result;
+        Array<1> zeroed = ones(4);
+        Array<1> ramp = ones(8);
+        {
+            ArenaScope arena(&pool);
+            shared[0] = 1.0;
+            result = outer + 1.0;
+            zeroed = zeros(4);
+            ramp = makeRamp(8);
+            check(&zeroed.storage()->allocator() != &ArrayAllocator::current(),
+                  "moved result does not take the arena");
+            check(&shared.storage()->allocator() != &ArrayAllocator::current(),
+                  "detached array does not take the arena");
+            check(&result.storage()->allocator() != &ArrayAllocator::current(),
+                  "reassigned array does not take the arena");
+        }
+        {
+            ArenaScope arena(&pool);
+            for (int k=0; k<10; ++k) {
+                Array<1> temp = ones(100) + double(k);
+                check(temp[99] == double(k+1), "arena array holds its values");
+            }
+        }
+        check(shared.size() == 100 && shared[0] == 1.0 && shared[1] == outer[1],
+              "detached array survives the arena");
+        check(result.size() == 100 && result[99] == 2.0,
+              "reassigned array survives the arena");
+        check(zeroed.size() == 4 && zeroed[0] == 0.0 && zeroed[3] == 0.0,
+              "array moved from the arena survives it");
+        check(ramp.size() == 8 && ramp[7] == 7.0,
+              "function result from the arena survives it");
+        Q_UNUSED(other)
+    }
+
+    Q_UNUSED(m)
+    ArrayAllocator::setCurrent(nullptr);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,98 @@
+#include <Ksl/ArrayProduct.h>
+using namespace Ksl;
+
+#include <iostream>
+#include <random>
+using namespace std;
+
+
+static int failures = 0;
+
+static void check(bool ok, const char *what) {
+    if (!ok) {
+        cout << "FAILED: " << what << endl;
+        failures += 1;
+    }
+}
+
+
+// Small integers, so that every order of the sums
+// gives the same double and results compare exactly
+static Array<2> randomMatrix(Index rows, Index cols, ArrayLayout layout,
+                             unsigned seed)
+{
+    mt19937 gen(seed);
+    uniform_int_distribution<int> dist(-3, 3);
+    Array<2> ret(rows, cols, layout);
+    double *data = ret.begin();
+    for (Index k=0; k<ret.size(); ++k) {
+        data[k] = dist(gen);
+    }
+    return ret;
+}
+
+
+static bool sameAsNaive(const ArrayMatrix<double> &a, const ArrayMatrix<double> &b,
+                        const Array<2> &c)
+{
+    if (c.rows() != a.rows() || c.cols() != b.cols()) {
+        return false;
+    }
+    for (Index i=0; i<a.rows(); ++i) {
+        for (Index j=0; j<b.cols(); ++j) {
+            double s = 0.0;
+            for (Index p=0; p<a.cols(); ++p) {
+                s += a(i,p)*b(p,j);
+            }
+            if (c(i,j) != s) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+
+int main()
+{
+    // Sizes that are not multiples of the 4x8 kernel,
+    // with edges on the MC, KC and NC blocks too
+    const Index sizes[][3] = {
+        {1, 1, 1}, {3, 5, 7}, {5, 3, 9}, {13, 17, 11},
+        {97, 259, 35}, {7, 5, 2051}
+    };
+    unsigned seed = 1;
+    for (auto &s : sizes) {
+        Index m = s[0], k = s[1], n = s[2];
+        const Array<2> a = randomMatrix(m, k, RowMajor, seed++);
+        const Array<2> b = randomMatrix(k, n, RowMajor, seed++);
+        check(sameAsNaive(a, b, matmul(a, b)), "row major matmul");
+
+        const Array<2> af = randomMatrix(m, k, ColumnMajor, seed++);
+        const Array<2> bf = randomMatrix(k, n, ColumnMajor, seed++);
+        check(sameAsNaive(af, bf, matmul(af, bf)), "column major matmul");
+        check(sameAsNaive(a, bf, matmul(a, bf)), "mixed layout matmul");
+
+        const Array<2> at = randomMatrix(k, m, RowMajor, seed++);
+        check(sameAsNaive(trans(at), b, matmul(trans(at), b)), "transposed matmul");
+    }
+
+    // Blocks are strided operands
+    const Array<2> big = randomMatrix(40, 50, RowMajor, 99);
+    auto a = block(big, 1, 2, 13, 21);
+    auto b = block(big, 3, 7, 21, 11);
+    check(sameAsNaive(a, b, matmul(a, b)), "matmul of blocks");
+    check(sameAsNaive(trans(b), trans(a), matmul(trans(b), trans(a))),
+          "matmul of transposed blocks");
+
+    // An empty inner dimension gives zeros, empty matrices
+    // have no shape so it comes from blocks
+    const Array<2> z = matmul(block(big, 0, 0, 3, 0), block(big, 0, 0, 0, 5));
+    check(z.rows() == 3 && z.cols() == 5 && z(0,0) == 0.0 && z(2,4) == 0.0,
+          "empty inner dimension");
+
+    if (failures == 0) {
+        cout << "All product tests passed" << endl;
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,50 @@
+#include <Ksl/Array.h>
+using namespace Ksl;
+
+#include <iostream>
+#include <thread>
+#include <vector>
+using namespace std;
+
+
+// Many threads copy and drop handles to the same
+// storages, as producers and the GUI thread do
+int main()
+{
+    const int numThreads = 8;
+    const int numRounds = 100000;
+
+    auto x = linspace(0.0, 1.0, 1000);
+    auto m = ones(100, 10);
+    const Array<0> *xStorage = x.storage();
+    const Array<0> *mStorage = m.storage();
+
+    vector<thread> threads;
+    for (int t=0; t<numThreads; ++t) {
+        threads.push_back(thread([&]() {
+            for (int k=0; k<numRounds; ++k) {
+                Array<1> copy = x;
+                ArrayView<double> view(copy);
+                ArrayView<double> column = col(m, k % 10);
+                ArrayView<double> other;
+                other = view;
+                if (other.size() != 1000 || column.size() != 100)
+                    cout << "FAILED: bad view size" << endl;
+            }
+        }));
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    int failures = 0;
+    if (xStorage->refCount() != 1) {
+        cout << "FAILED: vector refcount is " << xStorage->refCount() << endl;
+        failures += 1;
+    }
+    if (mStorage->refCount() != 1) {
+        cout << "FAILED: matrix refcount is " << mStorage->refCount() << endl;
+        failures += 1;
+    }
+    return failures ? 1 : 0;
+}
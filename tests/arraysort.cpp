@@ -0,0 +1,139 @@
+#include <Ksl/ArraySort.h>
+using namespace Ksl;
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+using namespace std;
+
+
+static int failures = 0;
+
+static void check(bool ok, const char *what) {
+    if (!ok) {
+        cout << "FAILED: " << what << endl;
+        failures += 1;
+    }
+}
+
+
+// Keys with many repeats, so that stability shows
+static Array<1,int> randomKeys(Index size, unsigned seed) {
+    mt19937 gen(seed);
+    uniform_int_distribution<int> dist(0, 999);
+    Array<1,int> ret(size);
+    int *data = ret.begin();
+    for (Index k=0; k<size; ++k) {
+        data[k] = dist(gen);
+    }
+    return ret;
+}
+
+
+// numpy.quantile with the default linear interpolation
+static double numpyQuantile(vector<double> sorted, double q) {
+    double pos = q*double(sorted.size() - 1);
+    size_t lo = size_t(std::floor(pos));
+    size_t hi = std::min(lo + 1, sorted.size() - 1);
+    return sorted[lo] + (pos - double(lo))*(sorted[hi] - sorted[lo]);
+}
+
+
+// Sorts above KSL_SORT_GRAIN x threads, so the runs are
+// merged by several threads, for an even and an odd count
+// of runs (the odd one is copied through a merge pass)
+static void checkSorts(int threads) {
+    ThreadPool::global().setThreadCount(threads);
+    const Index size = KSL_SORT_GRAIN*threads*2 + 12345;
+    const Array<1,int> keys = randomKeys(size, 17 + threads);
+    const int *k = keys.begin();
+
+    Array<1,int> sorted = keys;
+    sort(sorted);
+    vector<int> expected(k, k + size);
+    std::sort(expected.begin(), expected.end());
+    const int *s = static_cast<const Array<1,int>&>(sorted).begin();
+    check(std::equal(expected.begin(), expected.end(), s),
+          "sort matches std::sort");
+
+    const Array<1,int> idx = argsort(keys);
+    vector<int> order(size);
+    for (Index i=0; i<size; ++i) {
+        order[i] = int(i);
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [k](int a, int b) { return k[a] < k[b]; });
+    check(idx.size() == size && std::equal(order.begin(), order.end(), idx.begin()),
+          "argsort matches std::stable_sort");
+}
+
+
+int main()
+{
+    checkSorts(4);
+    checkSorts(3);
+
+    // quantiles interpolate as numpy does
+    Array<1> small = {4.0, 1.0, 3.0, 2.0};
+    check(quantile(small, 0.5) == 2.5, "quantile of an even count");
+    check(percentile(small, 25.0) == 1.75, "percentile between two elements");
+    check(quantile(small, 0.0) == 1.0 && quantile(small, 1.0) == 4.0,
+          "quantile end points");
+    check(median(Array<1>{5.0, -1.0, 3.0}) == 3.0, "median of an odd count");
+    check(std::isnan(quantile(Array<1>(), 0.5)), "quantile of nothing is NaN");
+
+    const Index size = KSL_SORT_GRAIN*4 + 7;
+    Array<1> values(size);
+    mt19937 gen(5);
+    normal_distribution<double> normal(0.0, 1.0);
+    double *v = values.begin();
+    for (Index k=0; k<size; ++k) {
+        v[k] = normal(gen);
+    }
+    const Array<1> &cvalues = values;
+    const vector<double> original(cvalues.begin(), cvalues.end());
+    vector<double> sorted = original;
+    std::sort(sorted.begin(), sorted.end());
+    double qs[] = {0.0, 0.01, 0.25, 0.5, 0.731, 0.999, 1.0};
+    for (double q : qs) {
+        double expected = numpyQuantile(sorted, q);
+        check(std::fabs(quantile(values, q) - expected) <= 1e-12*std::fabs(expected),
+              "quantile matches numpy");
+    }
+    check(std::equal(original.begin(), original.end(), cvalues.begin()),
+          "quantile leaves its argument alone");
+
+    // searchsorted sides, for values below, between,
+    // equal to and above the sorted elements
+    Array<1> grid = {1.0, 2.0, 2.0, 2.0, 3.0, 5.0};
+    check(searchsorted(grid, 2.0, SearchLeft) == 1, "left side of equal elements");
+    check(searchsorted(grid, 2.0, SearchRight) == 4, "right side of equal elements");
+    check(searchsorted(grid, 0.0, SearchLeft) == 0 &&
+          searchsorted(grid, 0.0, SearchRight) == 0, "value below all elements");
+    check(searchsorted(grid, 9.0, SearchLeft) == 6 &&
+          searchsorted(grid, 9.0, SearchRight) == 6, "value above all elements");
+    check(searchsorted(grid, 4.0, SearchLeft) == 5 &&
+          searchsorted(grid, 4.0, SearchRight) == 5, "value between elements");
+
+    // many values at once, searched in parallel
+    Array<1,int> table = randomKeys(1000, 3);
+    sort(table);
+    const Array<1,int> queries = randomKeys(KSL_PARALLEL_GRAIN + 11, 4);
+    const int *t = static_cast<const Array<1,int>&>(table).begin();
+    const Array<1,int> left = searchsorted(table, queries, SearchLeft);
+    const Array<1,int> right = searchsorted(table, queries, SearchRight);
+    bool sidesMatch = true;
+    for (Index k=0; k<queries.size(); ++k) {
+        int q = queries[k];
+        sidesMatch &= (left[k] == std::lower_bound(t, t + 1000, q) - t);
+        sidesMatch &= (right[k] == std::upper_bound(t, t + 1000, q) - t);
+    }
+    check(sidesMatch, "parallel searchsorted matches both sides");
+
+    if (failures == 0) {
+        cout << "All sort tests passed" << endl;
+    }
+    return failures == 0 ? 0 : 1;
+}
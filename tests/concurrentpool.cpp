@@ -0,0 +1,153 @@
+#include <Ksl/ConcurrentMemoryPool.h>
+using namespace Ksl;
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+using namespace std;
+
+
+struct Block {
+    unsigned char *ptr;
+    uint64_t size;
+};
+
+static uint64_t blockSize(int thread, int k) {
+    // mostly small classes, a few large blocks
+    return (k % 97 == 0) ? 100000 : uint64_t(16 + ((thread*31 + k*7) % 2000));
+}
+
+
+// Threads allocate, hand their blocks to other threads
+// to free, and exit so that their caches are adopted
+int main()
+{
+    const int numThreads = 8;
+    const int numBlocks = 20000;
+    const int numRounds = 3;
+
+    ConcurrentMemoryPool pool;
+    int failures = 0;
+    mutex failMutex;
+    auto fail = [&](const char *what) {
+        lock_guard<mutex> lock(failMutex);
+        cout << "FAILED: " << what << endl;
+        failures += 1;
+    };
+
+    vector<vector<Block>> blocks(numThreads);
+    for (int round=0; round<numRounds; ++round) {
+        // every thread fills blocks with its own mark
+        vector<thread> threads;
+        for (int t=0; t<numThreads; ++t) {
+            threads.push_back(thread([&, t]() {
+                for (int k=0; k<numBlocks; ++k) {
+                    uint64_t size = blockSize(t, k);
+                    auto ptr = (unsigned char*) pool.allocBytes(size);
+                    if (!ptr) {
+                        fail("allocation returned null");
+                        return;
+                    }
+                    std::memset(ptr, t + 1, size);
+                    blocks[t].push_back(Block{ptr, size});
+                }
+            }));
+        }
+        for (auto &t : threads) {
+            t.join();
+        }
+
+        // live blocks never overlap
+        vector<pair<unsigned char*,uint64_t>> all;
+        for (auto &list : blocks) {
+            for (auto &b : list) {
+                all.push_back(make_pair(b.ptr, b.size));
+            }
+        }
+        sort(all.begin(), all.end());
+        for (size_t k=1; k<all.size(); ++k) {
+            if (all[k-1].first + all[k-1].second > all[k].first) {
+                fail("blocks overlap");
+                break;
+            }
+        }
+
+        // other threads check the marks and free the blocks,
+        // half of them through a queue while they are still
+        // being produced
+        threads.clear();
+        mutex queueMutex;
+        condition_variable queueReady;
+        deque<Block> queue;
+        int producersLeft = numThreads/2;
+        for (int t=0; t<numThreads; ++t) {
+            threads.push_back(thread([&, t]() {
+                int owner = (t + 1) % numThreads;
+                for (auto &b : blocks[owner]) {
+                    if (b.ptr[0] != owner + 1 || b.ptr[b.size-1] != owner + 1) {
+                        fail("block was overwritten");
+                    }
+                    pool.freeBytes(b.ptr, b.size);
+                }
+                blocks[owner].clear();
+                if (t % 2 == 0) {
+                    for (int k=0; k<numBlocks; ++k) {
+                        uint64_t size = blockSize(t, k);
+                        void *ptr = pool.allocBytes(size);
+                        lock_guard<mutex> lock(queueMutex);
+                        queue.push_back(Block{(unsigned char*) ptr, size});
+                        queueReady.notify_one();
+                    }
+                    lock_guard<mutex> lock(queueMutex);
+                    producersLeft -= 1;
+                    queueReady.notify_all();
+                } else {
+                    for (;;) {
+                        unique_lock<mutex> lock(queueMutex);
+                        queueReady.wait(lock, [&]() {
+                            return !queue.empty() || producersLeft == 0;
+                        });
+                        if (queue.empty()) {
+                            break;
+                        }
+                        Block b = queue.front();
+                        queue.pop_front();
+                        lock.unlock();
+                        pool.freeBytes(b.ptr, b.size);
+                    }
+                }
+            }));
+        }
+        for (auto &t : threads) {
+            t.join();
+        }
+    }
+
+    auto stats = pool.stats();
+    uint64_t expected = uint64_t(numRounds)*numThreads*numBlocks*3/2;
+    if (stats.allocations != expected) {
+        cout << "FAILED: allocations are " << stats.allocations << endl;
+        failures += 1;
+    }
+    if (stats.releases != stats.allocations) {
+        cout << "FAILED: releases are " << stats.releases << endl;
+        failures += 1;
+    }
+    if (stats.largeBytes != 0) {
+        cout << "FAILED: large bytes are " << stats.largeBytes << endl;
+        failures += 1;
+    }
+    if (stats.threadCaches == 0 ||
+        stats.threadCaches > uint32_t(2*numRounds*numThreads))
+    {
+        cout << "FAILED: thread caches are " << stats.threadCaches << endl;
+        failures += 1;
+    }
+    return failures ? 1 : 0;
+}
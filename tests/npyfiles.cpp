@@ -0,0 +1,117 @@
+#include <Ksl/Npy.h>
+using namespace Ksl;
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+using namespace std;
+
+
+static int failures = 0;
+
+static void check(bool ok, const char *what) {
+    if (!ok) {
+        cout << "FAILED: " << what << endl;
+        failures += 1;
+    }
+}
+
+
+// Writes a version 1 .npy file with the given header
+// dict, as numpy would, followed by "data"
+static void writeNpy(const char *path, const string &dict, const string &data) {
+    string header = dict;
+    header.append(63 - (10 + header.size()) % 64, ' ');
+    header.append("\n");
+    ofstream out(path, ios::binary);
+    out << "\x93NUMPY" << char(1) << char(0);
+    out << char(header.size() & 0xff) << char(header.size() >> 8);
+    out << header << data;
+}
+
+
+int main()
+{
+    // 1D round trip, loaded as a mapping of the file
+    Array<1> x = linspace(0.0, 1.0, 11);
+    check(saveNpy("npy_x.npy", x), "1D array is saved");
+    auto x2 = loadNpy<1>("npy_x.npy");
+    check(x2.size() == 11 && x2[10] == 1.0 && x2[3] == x[3], "1D array round trip");
+
+    // 2D round trip, in both layouts
+    Array<2> m(3, 4);
+    Array<2> f(3, 4, ColumnMajor);
+    for (int i=0; i<3; ++i) {
+        for (int j=0; j<4; ++j) {
+            m(i,j) = i*10 + j;
+            f(i,j) = i*10 + j;
+        }
+    }
+    check(saveNpy("npy_m.npy", m), "row major matrix is saved");
+    check(saveNpy("npy_f.npy", f), "fortran ordered matrix is saved");
+    const Array<2> m2 = loadNpy<2>("npy_m.npy");
+    check(m2.layout() == RowMajor && m2.rows() == 3 && m2.cols() == 4 &&
+          m2(2,3) == 23.0 && m2(1,0) == 10.0, "row major matrix round trip");
+    const Array<2> f2 = loadNpy<2>("npy_f.npy");
+    check(f2.layout() == ColumnMajor && f2.rows() == 3 && f2.cols() == 4 &&
+          f2(2,3) == 23.0 && f2(0,1) == 1.0, "fortran ordered matrix round trip");
+    auto flat = loadNpy<1>("npy_m.npy");
+    check(flat.size() == 12 && flat[4] == 10.0, "matrix loads as a vector in file order");
+
+    // other dtypes are converted
+    Array<1,int> counts = {1, -2, 3};
+    check(saveNpy("npy_i.npy", counts), "int array is saved");
+    auto counts2 = loadNpy<1>("npy_i.npy");
+    check(counts2.size() == 3 && counts2[1] == -2.0, "int array converts to double");
+    auto mi = loadNpy<2,int>("npy_m.npy");
+    check(mi.rows() == 3 && mi(1,2) == 12, "double matrix converts to int");
+
+    // big endian doubles are swapped
+    double values[3] = {1.5, -2.25, 1e10};
+    string data;
+    for (double v : values) {
+        char bytes[8];
+        std::memcpy(bytes, &v, 8);
+        for (int k=7; k>=0; --k) {
+            data.push_back(bytes[k]);
+        }
+    }
+    writeNpy("npy_be.npy",
+             "{'descr': '>f8', 'fortran_order': False, 'shape': (3,), }", data);
+    auto be = loadNpy<1>("npy_be.npy");
+    check(be.size() == 3 && be[0] == 1.5 && be[1] == -2.25 && be[2] == 1e10,
+          "byte swapped dtype is converted");
+
+    // shapes beyond the file are rejected, also when
+    // their product overflows
+    writeNpy("npy_big.npy",
+             "{'descr': '<f8', 'fortran_order': False, 'shape': (1000, 1000), }",
+             string(64, '\0'));
+    check(loadNpy<2>("npy_big.npy").size() == 0, "shape larger than the file");
+    writeNpy("npy_wrap.npy",
+             "{'descr': '<f8', 'fortran_order': False, "
+             "'shape': (4611686018427387905, 4), }", string(64, '\0'));
+    check(loadNpy<1>("npy_wrap.npy").size() == 0, "shape that overflows");
+
+    // several entries in one .npz
+    {
+        NpzWriter npz("npy_all.npz");
+        check(npz.isOpen(), "npz is created");
+        check(npz.add("x", x), "vector is added to the npz");
+        check(npz.add("m", m), "matrix is added to the npz");
+        check(npz.add("f", f), "fortran matrix is added to the npz");
+        check(npz.add("i", counts), "int array is added to the npz");
+    }
+    auto zx = loadNpz<1>("npy_all.npz", "x");
+    check(zx.size() == 11 && zx[10] == 1.0, "npz vector");
+    const Array<2> zm = loadNpz<2>("npy_all.npz", "m.npy");
+    check(zm.rows() == 3 && zm(2,1) == 21.0, "npz matrix by file name");
+    const Array<2> zf = loadNpz<2>("npy_all.npz", "f");
+    check(zf.layout() == ColumnMajor && zf(1,3) == 13.0, "npz fortran matrix");
+    auto zi = loadNpz<1,int>("npy_all.npz", "i");
+    check(zi.size() == 3 && zi[2] == 3, "npz int array");
+    check(loadNpz<1>("npy_all.npz", "missing").size() == 0, "missing npz entry");
+
+    return failures ? 1 : 0;
+}